@@ -3,19 +3,116 @@
 #include "config.h"
 #include <avr/interrupt.h>
 #include "timer.h"
+#include "profile.h"
+#include "sched.h"
 
 // Global variables
 volatile uint8_t adc_conversion_complete = 0;
-volatile uint8_t current_adc_channel = 0;
+volatile uint8_t current_adc_channel = ADC_SEQ_IDLE;
 
-// Variables for 24-sample collection
-volatile uint16_t voltage_samples_raw[SAMPLE_BUFFER_SIZE] = {0};
-volatile uint16_t current_samples_raw[SAMPLE_BUFFER_SIZE] = {0};
+// Variables for 24-sample collection (one set per bank)
+#if ADC_ACCUMULATION_MODE == ADC_ACCUM_STREAMING
+volatile adc_stream_sums_t adc_stream_sums[ADC_BANK_COUNT];
+
+// Previous voltage and current sample, for the interpolated V·I terms
+static uint16_t stream_last_v = 0;
+static uint16_t stream_last_i = 0;
+#else
+volatile uint16_t voltage_samples_raw[ADC_BANK_COUNT][SAMPLE_BUFFER_SIZE] = {{0}};
+volatile uint16_t current_samples_raw[ADC_BANK_COUNT][SAMPLE_BUFFER_SIZE] = {{0}};
+#endif
 volatile uint16_t offset_sample = 0;
 volatile uint8_t sample_count = 0;
 volatile uint8_t adc_sample_complete = 0;
 
+// Bank bookkeeping: ADC_vect writes adc_fill_bank, the main loop reads
+// adc_ready_bank while adc_sample_complete is set
+static volatile uint8_t adc_fill_bank = 0;
+static volatile uint8_t adc_ready_bank = 1;
+static volatile uint8_t adc_sequence_running = 0;
+static volatile uint32_t adc_bank_start_ticks[ADC_BANK_COUNT] = {0};  // Timer1 timestamp of each sequence
+
+// Conversion trigger spacing in Timer1 ticks: interval + remainder / conversions,
+// spread Bresenham-style so the sequence spans exactly the requested cycles
+static volatile uint16_t adc_interval_ticks = (uint16_t)((uint32_t)F_CPU / LINE_FREQ_NOMINAL_HZ * SAMPLE_CYCLES_PER_SEQUENCE / ADC_CONVERSIONS_PER_SEQUENCE);
+static volatile uint8_t adc_interval_rem = 0;
+static volatile uint8_t adc_interval_acc = 0;
+
+// Run-time sampling set-up (adc_set_sampling()). The requested values are
+// taken over when the next sequence starts, never part way through one;
+// adc_bank_samples keeps the count each bank was filled with.
+static volatile uint8_t adc_samples_requested = SAMPLE_BUFFER_SIZE;
+static volatile uint16_t adc_interval_requested = 0;   // 0 = locked to the mains period
+static volatile uint8_t adc_samples = SAMPLE_BUFFER_SIZE;
+static volatile uint8_t adc_conversions = ADC_CONVERSIONS_PER_SEQUENCE;
+static volatile uint8_t adc_bank_samples[ADC_BANK_COUNT] = {SAMPLE_BUFFER_SIZE, SAMPLE_BUFFER_SIZE};
+
+// Offset reference tracking: exponential running mean and variance of the
+// background ADC2 conversions, in fixed point
+static volatile uint16_t offset_filtered_q = 0;   // Q(ADC_OFFSET_FRAC_BITS) counts
+static volatile uint32_t offset_variance_q = 0;   // Q(2 * ADC_OFFSET_FRAC_BITS) counts^2
+static volatile uint8_t offset_filter_seeded = 0;
+
+// Cycle accounting: every INT0 edge is either a completed or a dropped cycle
+static volatile uint16_t adc_completed_cycles = 0;
+static volatile uint16_t adc_dropped_cycles = 0;
+
+
+#if ADC_ACCUMULATION_MODE == ADC_ACCUM_STREAMING
+// Resets the running sums of one bank before a sequence is written into it
+static void adc_stream_clear(uint8_t bank)
+{
+    adc_stream_sums[bank].sum_v = 0;
+    adc_stream_sums[bank].sum_v_sq = 0;
+    adc_stream_sums[bank].sum_vi = 0;
+    adc_stream_sums[bank].sum_vi_lin = 0;
+    adc_stream_sums[bank].sum_i = 0;
+    adc_stream_sums[bank].sum_i_sq = 0;
+    adc_stream_sums[bank].max_i = 0;
+}
 
+/*
+ * Accumulates one voltage sample v[k]
+ *
+ * v[k]·i[k-1] appears once in the interpolated power of sample k
+ * (through i_bar) and once in that of sample k-1 (through v_bar), but only
+ * inner samples 1..N-2 contribute, so the pair weight is 1 at both ends.
+ */
+static inline void adc_stream_add_voltage(volatile adc_stream_sums_t *sums, uint8_t k, uint16_t v)
+{
+    sums->sum_v += v;
+    sums->sum_v_sq += (uint32_t)v * v;
+
+    if (k > 0) {
+        uint32_t product = (uint32_t)stream_last_i * v;
+        uint16_t linear = stream_last_i + v;
+        if (k > 1 && k < adc_samples - 1) {
+            product <<= 1;
+            linear <<= 1;
+        }
+        sums->sum_vi += product;
+        sums->sum_vi_lin += linear;
+    }
+    stream_last_v = v;
+}
+
+// Accumulates one current sample i[k]; v[k]·i[k] has weight 2 on inner samples
+static inline void adc_stream_add_current(volatile adc_stream_sums_t *sums, uint8_t k, uint16_t i)
+{
+    sums->sum_i += i;
+    sums->sum_i_sq += (uint32_t)i * i;
+
+    if (i > sums->max_i) {
+        sums->max_i = i;
+    }
+
+    if (k > 0 && k < adc_samples - 1) {
+        sums->sum_vi += ((uint32_t)stream_last_v * i) << 1;
+        sums->sum_vi_lin += (uint32_t)(stream_last_v + i) << 1;
+    }
+    stream_last_i = i;
+}
+#endif
 
 // ADC Initialization
 void adc_init(void)
@@ -32,14 +129,32 @@ void adc_init(void)
 	ADCSRB |= (1 << ADTS0) | (1 << ADTS2);
 	ADCSRB &= ~(1 << ADTS1);
     
-    // Initialise voltage_samples, current_samples and offset_sample
-    for (uint8_t i = 0; i < SAMPLE_BUFFER_SIZE; i++) {
-        voltage_samples_raw[i] = 0;
-        current_samples_raw[i] = 0;
+    // Initialise voltage_samples and current_samples in both banks
+    for (uint8_t bank = 0; bank < ADC_BANK_COUNT; bank++) {
+#if ADC_ACCUMULATION_MODE == ADC_ACCUM_STREAMING
+        adc_stream_clear(bank);
+#else
+        for (uint8_t i = 0; i < SAMPLE_BUFFER_SIZE; i++) {
+            voltage_samples_raw[bank][i] = 0;
+            current_samples_raw[bank][i] = 0;
+        }
+#endif
     }
     offset_sample = 0;
+    offset_filtered_q = (uint16_t)((ADC_MAX_VALUE + 1) / 2) << ADC_OFFSET_FRAC_BITS;
+    offset_variance_q = 0;
+    offset_filter_seeded = 0;
     adc_sample_complete = 0;
-    current_adc_channel = 0;
+    current_adc_channel = ADC_SEQ_IDLE;
+    adc_fill_bank = 0;
+    adc_ready_bank = 1;
+    adc_sequence_running = 0;
+    adc_completed_cycles = 0;
+    adc_dropped_cycles = 0;
+    adc_samples_requested = SAMPLE_BUFFER_SIZE;
+    adc_interval_requested = 0;
+    adc_samples = SAMPLE_BUFFER_SIZE;
+    adc_conversions = ADC_CONVERSIONS_PER_SEQUENCE;
 }
 
 void adc_enable_auto_trigger(void)
@@ -82,38 +197,319 @@ uint8_t adc_is_conversion_running(void)
     return (ADCSRA & (1 << ADSC)) ? 1 : 0;
 }
 
+/*
+ * Folds one offset conversion into the running mean and variance
+ *
+ *   mean += (x - mean) / 2^k
+ *   var  += ((x - mean)^2 - var) / 2^k
+ *
+ * with k = ADC_OFFSET_FILTER_SHIFT. The first sample seeds the mean so the
+ * filter does not have to slew up from mid-scale.
+ */
+static void adc_offset_update(uint16_t sample)
+{
+    int32_t sample_q = (int32_t)sample << ADC_OFFSET_FRAC_BITS;
 
-// ADC Complete Interrupt Service Routine
-ISR(ADC_vect)
+    if (!offset_filter_seeded) {
+        offset_filtered_q = (uint16_t)sample_q;
+        offset_variance_q = 0;
+        offset_filter_seeded = 1;
+        return;
+    }
+
+    int32_t deviation = sample_q - (int32_t)offset_filtered_q;
+    offset_filtered_q = (uint16_t)((int32_t)offset_filtered_q + (deviation >> ADC_OFFSET_FILTER_SHIFT));
+
+    // Clamp gross glitches (> 512 counts) so the square stays inside int32_t
+    if (deviation > INT16_MAX) {
+        deviation = INT16_MAX;
+    } else if (deviation < -INT16_MAX) {
+        deviation = -INT16_MAX;
+    }
+    int32_t deviation_sq = deviation * deviation;
+    offset_variance_q = (uint32_t)((int32_t)offset_variance_q
+        + ((deviation_sq - (int32_t)offset_variance_q) >> ADC_OFFSET_FILTER_SHIFT));
+}
+
+/*
+ * Ends the V/I part of a sequence: hands the bank to the main loop and
+ * starts a single background conversion of the offset reference
+ */
+static void adc_finish_sequence(void)
+{
+    adc_disable_auto_trigger();  // All samples collected, Timer1 keeps running
+    adc_sequence_running = 0;
+
+    if (adc_sample_complete) {
+        // Main loop still owns the other bank: this cycle is lost and
+        // the fill bank is simply overwritten by the next sequence
+        adc_dropped_cycles++;
+    } else {
+        // Hand the filled bank to the main loop and swap
+        adc_ready_bank = adc_fill_bank;
+        adc_fill_bank ^= 1;
+        adc_completed_cycles++;
+        set_adc_sample_complete(1);
+        sched_trigger(SCHED_TASK_METRICS);
+    }
+
+    // The result is folded into the offset filter; the bank above does not wait for it
+    current_adc_channel = 2;
+    adc_start_conversion(ADC_CH_OFFSET);
+}
+
+/*
+ * Derives the conversion interval from the measured mains period
+ *
+ * SAMPLE_CYCLES_PER_SEQUENCE cycles are split into 2 x samples equal slots,
+ * so the V and I samples each cover the wave at uniform phase steps and the
+ * sums integrate over whole cycles. A fixed interval set with
+ * adc_set_sampling() replaces this. Called from INT0_vect between sequences,
+ * so it also takes over a pending sample count for the next sequence.
+ */
+void adc_set_line_period(uint16_t period_ticks)
+{
+    uint8_t conversions = 2 * adc_samples_requested;
+
+    adc_samples = adc_samples_requested;
+    adc_conversions = conversions;
+    if (adc_interval_requested != 0) {
+        adc_interval_ticks = adc_interval_requested;
+        adc_interval_rem = 0;
+        return;
+    }
+
+    uint32_t span_ticks = (uint32_t)period_ticks * SAMPLE_CYCLES_PER_SEQUENCE;
+    uint16_t interval = (uint16_t)(span_ticks / conversions);
+    uint8_t remainder = (uint8_t)(span_ticks % conversions);
+
+    if (interval < ADC_MIN_INTERVAL_TICKS) {
+        // Too fast for the ADC: sample as fast as possible, the sequence overruns the span
+        interval = ADC_MIN_INTERVAL_TICKS;
+        remainder = 0;
+    }
+    adc_interval_ticks = interval;
+    adc_interval_rem = remainder;
+}
+
+// Schedules the next auto-trigger one interval after the one that just fired
+static inline void adc_schedule_next_conversion(void)
+{
+    uint16_t step = adc_interval_ticks;
+
+    adc_interval_acc += adc_interval_rem;
+    if (adc_interval_acc >= adc_conversions) {
+        adc_interval_acc -= adc_conversions;
+        step++;
+    }
+    timer1_advance_compare_b(step);
+}
+
+/*
+ * Starts a new V/I sequence into the current fill bank
+ *
+ * Called from INT0_vect on every zero-crossing with the edge timestamp. The
+ * first conversion starts immediately; ADC_vect then schedules the following
+ * ones on Timer1 compare match B. The caller must check
+ * adc_is_sequence_running() first; a sequence is never restarted mid-way.
+ */
+void adc_start_sequence(uint32_t start_ticks)
+{
+    if (current_adc_channel == 2) {
+        // Background offset conversion still running (at most 13 ADC clocks):
+        // finish it here so ADC_vect does not mistake it for a voltage sample
+        while (adc_is_conversion_running());
+        offset_sample = ADC;
+        adc_offset_update(offset_sample);
+        ADCSRA |= (1 << ADIF);
+    }
+
+    sample_count = 0;
+    current_adc_channel = 0;
+    adc_sequence_running = 1;
+    adc_bank_start_ticks[adc_fill_bank] = start_ticks;
+    adc_bank_samples[adc_fill_bank] = adc_samples;
+#if ADC_ACCUMULATION_MODE == ADC_ACCUM_STREAMING
+    adc_stream_clear(adc_fill_bank);
+#endif
+
+    // Compare B at the (already passed) start instant: ADC_vect moves it one
+    // interval on after every conversion
+    adc_interval_acc = 0;
+    timer1_set_compare_b((uint16_t)start_ticks);
+    adc_enable_auto_trigger();
+    adc_start_conversion(ADC_CH_VMEAS); // Start conversion on voltage channel
+}
+
+// Returns 1 while ADC_vect is still filling a bank
+uint8_t adc_is_sequence_running(void)
+{
+    return adc_sequence_running;
+}
+
+// Bank holding the last completed sequence (valid while adc_sample_complete is set)
+uint8_t adc_get_ready_bank(void)
+{
+    return adc_ready_bank;
+}
+
+// Timer1 timestamp (32-bit) of the INT0 edge that started the sequence in 'bank'
+uint32_t adc_get_bank_start_ticks(uint8_t bank)
+{
+    return adc_bank_start_ticks[bank];
+}
+
+// V/I pairs in the sequence held by 'bank'
+uint8_t adc_get_bank_samples(uint8_t bank)
+{
+    return adc_bank_samples[bank];
+}
+
+/*
+ * Requests a new sampling set-up from the next sequence on
+ *
+ * 'samples' V/I pairs per sequence (ADC_MIN_SAMPLES..SAMPLE_BUFFER_SIZE) and
+ * 'interval_ticks' Timer1 ticks between conversions, or 0 to keep spreading
+ * the samples over SAMPLE_CYCLES_PER_SEQUENCE mains cycles. A fixed interval
+ * no longer integrates over whole cycles; it is meant for waveform capture.
+ * Returns 0 and changes nothing if a value is out of range.
+ */
+uint8_t adc_set_sampling(uint8_t samples, uint16_t interval_ticks)
+{
+    if (samples < ADC_MIN_SAMPLES || samples > SAMPLE_BUFFER_SIZE
+        || (interval_ticks != 0 && interval_ticks < ADC_MIN_INTERVAL_TICKS)) {
+        return 0;
+    }
+    uint8_t sreg = SREG;
+    cli();
+    adc_samples_requested = samples;
+    adc_interval_requested = interval_ticks;
+    SREG = sreg;
+    return 1;
+}
+
+// Requested V/I pairs per sequence
+uint8_t adc_get_samples(void)
+{
+    return adc_samples_requested;
+}
+
+// Requested conversion interval in Timer1 ticks (0 = locked to the mains period)
+uint16_t adc_get_interval(void)
+{
+    uint8_t sreg = SREG;
+    cli();
+    uint16_t interval = adc_interval_requested;
+    SREG = sreg;
+    return interval;
+}
+
+// Number of sequences handed to the main loop since adc_init()
+uint16_t adc_get_completed_cycles(void)
+{
+    uint8_t sreg = SREG;
+    cli();
+    uint16_t count = adc_completed_cycles;
+    SREG = sreg;
+    return count;
+}
+
+// Number of mains cycles that were not measured since adc_init()
+uint16_t adc_get_dropped_cycles(void)
+{
+    uint8_t sreg = SREG;
+    cli();
+    uint16_t count = adc_dropped_cycles;
+    SREG = sreg;
+    return count;
+}
+
+// Filtered offset reference in Q(ADC_OFFSET_FRAC_BITS) ADC counts
+uint16_t adc_get_offset_filtered(void)
+{
+    uint8_t sreg = SREG;
+    cli();
+    uint16_t offset = offset_filtered_q;
+    SREG = sreg;
+    return offset;
+}
+
+// Filtered offset rounded to whole ADC counts, as used by the power math
+uint16_t adc_get_offset(void)
+{
+    return (adc_get_offset_filtered() + (1 << (ADC_OFFSET_FRAC_BITS - 1))) >> ADC_OFFSET_FRAC_BITS;
+}
+
+// Running variance of the offset reference in Q(2 * ADC_OFFSET_FRAC_BITS) counts^2
+uint32_t adc_get_offset_variance(void)
+{
+    uint8_t sreg = SREG;
+    cli();
+    uint32_t variance = offset_variance_q;
+    SREG = sreg;
+    return variance;
+}
+
+// Records a mains cycle that could not be sampled (called from ISR context)
+void adc_count_dropped_cycle(void)
+{
+    adc_dropped_cycles++;
+}
+
+
+// Stores a finished conversion and schedules the next one (ADC_vect body)
+static inline void adc_handle_conversion(void)
 {
     // Store result based on current channel being sampled
     if (current_adc_channel == 0) {
         // Voltage sample
-        voltage_samples_raw[sample_count] = ADC;
+#if ADC_ACCUMULATION_MODE == ADC_ACCUM_STREAMING
+        adc_stream_add_voltage(&adc_stream_sums[adc_fill_bank], sample_count, ADC);
+#else
+        voltage_samples_raw[adc_fill_bank][sample_count] = ADC;
+#endif
         current_adc_channel = 1; // Next sample will be current
     } else if (current_adc_channel == 1) {
         // Current sample
-        current_samples_raw[sample_count] = ADC;
+#if ADC_ACCUMULATION_MODE == ADC_ACCUM_STREAMING
+        adc_stream_add_current(&adc_stream_sums[adc_fill_bank], sample_count, ADC);
+#else
+        current_samples_raw[adc_fill_bank][sample_count] = ADC;
+#endif
 		current_adc_channel = 0; // Next sample will be voltage
-		sample_count++;      // Increment after all three channels are sampled
-		if(sample_count >= SAMPLE_BUFFER_SIZE){
-			current_adc_channel = 2;
+		sample_count++;      // Increment after each V/I pair
+		if(sample_count >= adc_samples){
+			adc_finish_sequence();
+			return;
 		}
     } else if (current_adc_channel == 2) {
-        // Offset sample
+        // Background offset sample, taken between sequences
         offset_sample = ADC;
-		set_adc_sample_complete(1);
-        timer1_stop();  // All samples collected, stop Timer1
-        adc_disable_auto_trigger();
+        adc_offset_update(offset_sample);
+        current_adc_channel = ADC_SEQ_IDLE;
 		return;
     }
     
-    // Start next conversion on the next channel using existing function
+    // Select the next channel and schedule its conversion on Timer1 compare B
     if (current_adc_channel == 0) {
         adc_switch_channel(ADC_CH_VMEAS);
     } else if (current_adc_channel == 1) {
         adc_switch_channel(ADC_CH_IMEAS);
-    } else if(current_adc_channel == 2 ){
-		adc_switch_channel(ADC_CH_OFFSET);
-	}
+    }
+    adc_schedule_next_conversion();
+}
+
+// ADC Complete Interrupt Service Routine
+ISR(ADC_vect)
+{
+    PROFILE_ISR_ENTER();
+#if PROFILE_ISR
+    // V/I conversions after the first of a sequence were started by compare
+    // match B at OCR1B, which still holds that instant
+    if (current_adc_channel == 1 || (current_adc_channel == 0 && sample_count != 0)) {
+        PROFILE_ISR_LATENCY(PROFILE_ID_ADC, OCR1B + ADC_CONVERSION_TICKS);
+    }
+#endif
+    adc_handle_conversion();
+    PROFILE_ISR_EXIT(PROFILE_ID_ADC);
 }
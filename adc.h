@@ -15,6 +15,48 @@
 #define ADC_CH_IMEAS 1     // PC1 - Current measurement  
 #define ADC_CH_OFFSET 2    // PC2 - Offset reference
 
+// Ping-pong sample banks: ADC_vect fills one bank while the main loop
+// reduces the other, so a new sequence can start on every INT0 edge
+#define ADC_BANK_COUNT 2
+
+// Conversions per sequence (one V and one I per sample) and the shortest
+// trigger interval ADC_vect can keep up with: 13 ADC clocks plus ISR time
+#define ADC_CONVERSIONS_PER_SEQUENCE (2 * SAMPLE_BUFFER_SIZE)
+#define ADC_MIN_INTERVAL_TICKS (13 * ADC_PRESCALER + 64)
+
+// Fewest V/I pairs adc_set_sampling() accepts: the power sum needs inner samples
+#define ADC_MIN_SAMPLES 3
+
+// Trigger to result of an auto-triggered conversion: 13.5 ADC clocks
+#define ADC_CONVERSION_TICKS (27 * ADC_PRESCALER / 2)
+
+// current_adc_channel while no conversion is pending (0 = V, 1 = I, 2 = offset)
+#define ADC_SEQ_IDLE 3
+
+// Offset reference filter: fractional bits of the running mean and the
+// smoothing shift (time constant of 2^shift offset samples, one per cycle)
+#define ADC_OFFSET_FRAC_BITS 6
+#define ADC_OFFSET_FILTER_SHIFT 4
+
+#if ADC_ACCUMULATION_MODE == ADC_ACCUM_STREAMING
+// Raw (offset not yet removed) sums built inside ADC_vect, one set per bank.
+// The V·I products follow the linear interpolation of the buffered
+// reduction (I_L_bar = (I_L[i-1] + I_L[i]) / 2, V_AC_bar = (V_AC[i] +
+// V_AC[i+1]) / 2) over the inner samples, scaled by 2 so no halving is
+// needed; powercalc.c removes the offset algebraically.
+typedef struct {
+    uint32_t sum_v;        // Σ v over all samples
+    uint32_t sum_v_sq;     // Σ v² over all samples
+    uint32_t sum_vi;       // Σ w·v·i over the interpolated pairs (w = 1 or 2)
+    uint32_t sum_vi_lin;   // Σ w·(v + i) over the same pairs
+    uint32_t sum_i;        // Σ i over all samples
+    uint32_t sum_i_sq;     // Σ i² over all samples
+    uint16_t max_i;        // largest current sample
+} adc_stream_sums_t;
+
+// Total weight of the terms in sum_vi: four products per inner sample
+#define ADC_STREAM_VI_WEIGHT(samples) (4UL * ((samples) - 2))
+#endif
 
 
 // Function declarations
@@ -27,10 +69,29 @@ uint8_t adc_is_conversion_running(void);
 void adc_switch_channel(uint8_t channel);
 void adc_enable_auto_trigger(void);
 void adc_disable_auto_trigger(void);
-// Variables for 24-sample collection
-extern volatile uint16_t voltage_samples_raw[SAMPLE_BUFFER_SIZE];
-extern volatile uint16_t current_samples_raw[SAMPLE_BUFFER_SIZE];
-extern volatile uint16_t offset_sample; 
+void adc_set_line_period(uint16_t period_ticks);
+void adc_start_sequence(uint32_t start_ticks);
+uint32_t adc_get_bank_start_ticks(uint8_t bank);
+uint8_t adc_get_bank_samples(uint8_t bank);
+uint8_t adc_set_sampling(uint8_t samples, uint16_t interval_ticks);
+uint8_t adc_get_samples(void);
+uint16_t adc_get_interval(void);
+uint8_t adc_is_sequence_running(void);
+uint8_t adc_get_ready_bank(void);
+uint16_t adc_get_completed_cycles(void);
+uint16_t adc_get_dropped_cycles(void);
+void adc_count_dropped_cycle(void);
+uint16_t adc_get_offset_filtered(void);
+uint16_t adc_get_offset(void);
+uint32_t adc_get_offset_variance(void);
+// Variables for 24-sample collection (one set per bank)
+#if ADC_ACCUMULATION_MODE == ADC_ACCUM_STREAMING
+extern volatile adc_stream_sums_t adc_stream_sums[ADC_BANK_COUNT];
+#else
+extern volatile uint16_t voltage_samples_raw[ADC_BANK_COUNT][SAMPLE_BUFFER_SIZE];
+extern volatile uint16_t current_samples_raw[ADC_BANK_COUNT][SAMPLE_BUFFER_SIZE];
+#endif
+extern volatile uint16_t offset_sample;  // last raw offset conversion
 extern volatile uint8_t sample_count;
 extern volatile uint8_t adc_sample_complete;
 extern volatile uint8_t current_adc_channel;
@@ -0,0 +1,268 @@
+#include "command.h"
+#include "uart.h"
+#include "telemetry.h"
+#include "adc.h"
+#include "powercalc.h"
+#include "profile.h"
+#include "display.h"
+#include "sched.h"
+#include "numfmt.h"
+#include <avr/pgmspace.h>
+
+// Skips spaces; returns 1 if the end of the line was reached
+static uint8_t skip_spaces(const char **cursor)
+{
+    while (**cursor == ' ') {
+        (*cursor)++;
+    }
+    return **cursor == '\0';
+}
+
+// Consumes 'word' (in flash) if it is the next whole word of the line
+static uint8_t match_word(const char **cursor, const char *word)
+{
+    const char *p = *cursor;
+    char c;
+
+    skip_spaces(&p);
+    while ((c = (char)pgm_read_byte(word++)) != '\0') {
+        if (*p++ != c) {
+            return 0;
+        }
+    }
+    if (*p != ' ' && *p != '\0') {
+        return 0;
+    }
+    *cursor = p;
+    return 1;
+}
+
+// Consumes a decimal number (0..65535) if it is the next whole word of the line
+static uint8_t match_number(const char **cursor, uint16_t *value)
+{
+    const char *p = *cursor;
+    uint32_t number = 0;
+
+    skip_spaces(&p);
+    if (*p < '0' || *p > '9') {
+        return 0;
+    }
+    while (*p >= '0' && *p <= '9') {
+        number = number * 10 + (uint8_t)(*p++ - '0');
+        if (number > UINT16_MAX) {
+            return 0;
+        }
+    }
+    if (*p != ' ' && *p != '\0') {
+        return 0;
+    }
+    *value = (uint16_t)number;
+    *cursor = p;
+    return 1;
+}
+
+// Appends 'text' to the reply, truncating at COMMAND_REPLY_MAX
+static uint8_t append_text(char *reply, uint8_t length, const char *text)
+{
+    while (*text != '\0' && length < COMMAND_REPLY_MAX - 1) {
+        reply[length++] = *text++;
+    }
+    reply[length] = '\0';
+    return length;
+}
+
+// Same for 'text' in flash
+static uint8_t append_text_P(char *reply, uint8_t length, const char *text)
+{
+    char c;
+    while ((c = (char)pgm_read_byte(text++)) != '\0' && length < COMMAND_REPLY_MAX - 1) {
+        reply[length++] = c;
+    }
+    reply[length] = '\0';
+    return length;
+}
+
+static uint8_t append_number(char *reply, uint8_t length, uint32_t value)
+{
+    char digits[NUMFMT_BUFFER_SIZE];
+
+    numfmt_fixed(digits, value, 0, 0);
+    return append_text(reply, length, digits);
+}
+
+// Trim between the command-line decimal form and Q(CAL_TRIM_FRAC_BITS), rounded
+static uint16_t trim_from_decimal(uint16_t decimal)
+{
+    return (uint16_t)(((uint32_t)decimal * CAL_TRIM_ONE + CAL_TRIM_DECIMAL_ONE / 2) / CAL_TRIM_DECIMAL_ONE);
+}
+
+static uint16_t trim_to_decimal(uint16_t trim_q)
+{
+    return (uint16_t)(((uint32_t)trim_q * CAL_TRIM_DECIMAL_ONE + CAL_TRIM_ONE / 2) >> CAL_TRIM_FRAC_BITS);
+}
+
+// Sends a reply in the current report format
+static void command_reply(const char *reply, uint8_t length)
+{
+    if (telemetry_get_format() == TELEMETRY_FORMAT_TEXT) {
+        usart_transmit_string(reply);
+        usart_transmit_string_P(PSTR("\r\n"));
+    } else {
+        telemetry_send_frame(TELEMETRY_FRAME_REPLY, (const uint8_t *)reply, length);
+    }
+}
+
+static const char mode_name_text[] PROGMEM = "text";
+static const char mode_name_binary[] PROGMEM = "binary";
+static const char mode_name_waveform[] PROGMEM = "waveform";
+static const char *const mode_names[] PROGMEM = { mode_name_text, mode_name_binary, mode_name_waveform };
+
+// Builds the status reply: "samples 37 interval 0 cal 10000 10000 mode text"
+static uint8_t command_status(char *reply)
+{
+    uint8_t format = telemetry_get_format();
+    uint8_t length = 0;
+
+    length = append_text_P(reply, length, PSTR("samples "));
+    length = append_number(reply, length, adc_get_samples());
+    length = append_text_P(reply, length, PSTR(" interval "));
+    length = append_number(reply, length, adc_get_interval());
+    length = append_text_P(reply, length, PSTR(" cal "));
+    length = append_number(reply, length, trim_to_decimal(powercalc_get_voltage_trim()));
+    length = append_text_P(reply, length, PSTR(" "));
+    length = append_number(reply, length, trim_to_decimal(powercalc_get_current_trim()));
+    length = append_text_P(reply, length, PSTR(" mode "));
+    length = append_text_P(reply, length, format < 3 ? pgm_read_ptr(&mode_names[format]) : PSTR("?"));
+    return length;
+}
+
+// Parses a report format name or its one-letter short form
+static uint8_t match_format(const char **cursor, uint8_t *format)
+{
+    if (match_word(cursor, PSTR("text")) || match_word(cursor, PSTR("t"))) {
+        *format = TELEMETRY_FORMAT_TEXT;
+    } else if (match_word(cursor, PSTR("binary")) || match_word(cursor, PSTR("b"))) {
+        *format = TELEMETRY_FORMAT_BINARY;
+    } else if (match_word(cursor, PSTR("waveform")) || match_word(cursor, PSTR("w"))) {
+        *format = TELEMETRY_FORMAT_WAVEFORM;
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * Runs one command line; returns 1 if it was understood and applied
+ *
+ * Arguments are parsed and the end of the line checked before anything is
+ * changed, so a malformed command has no effect.
+ */
+static uint8_t command_execute(const char *line, char *reply, uint8_t *reply_length)
+{
+    const char *cursor = line;
+    uint16_t first;
+    uint16_t second;
+    uint8_t format;
+
+    if (match_word(&cursor, PSTR("mode"))) {
+        if (!match_format(&cursor, &format) || !skip_spaces(&cursor)) {
+            return 0;
+        }
+        telemetry_set_format(format);
+        return telemetry_get_format() == format;  // Waveform needs buffered accumulation
+    }
+    if (match_format(&cursor, &format)) {
+        if (!skip_spaces(&cursor)) {
+            return 0;
+        }
+        telemetry_set_format(format);
+        return telemetry_get_format() == format;
+    }
+    if (match_word(&cursor, PSTR("samples"))) {
+        if (!match_number(&cursor, &first) || !skip_spaces(&cursor) || first > UINT8_MAX) {
+            return 0;
+        }
+        return adc_set_sampling((uint8_t)first, adc_get_interval());
+    }
+    if (match_word(&cursor, PSTR("interval"))) {
+        if (!match_number(&cursor, &first) || !skip_spaces(&cursor)) {
+            return 0;
+        }
+        return adc_set_sampling(adc_get_samples(), first);
+    }
+    if (match_word(&cursor, PSTR("cal"))) {
+        if (!match_number(&cursor, &first) || !match_number(&cursor, &second)
+            || !skip_spaces(&cursor)
+            || first >= 2 * CAL_TRIM_DECIMAL_ONE || second >= 2 * CAL_TRIM_DECIMAL_ONE) {
+            return 0;
+        }
+        return powercalc_set_calibration(trim_from_decimal(first), trim_from_decimal(second));
+    }
+    if (match_word(&cursor, PSTR("bright"))) {
+        if (skip_spaces(&cursor)) {
+            // No argument: report the current level
+            *reply_length = append_text_P(reply, 0, PSTR("bright "));
+            *reply_length = append_number(reply, *reply_length, display_get_brightness());
+            return 1;
+        }
+        if (!match_number(&cursor, &first) || !skip_spaces(&cursor) || first > UINT8_MAX) {
+            return 0;
+        }
+        return display_set_brightness((uint8_t)first);
+    }
+    // The dumps are plain text: in the binary formats they would land in
+    // the middle of the COBS stream, so they are refused there
+    if (match_word(&cursor, PSTR("prof")) || match_word(&cursor, PSTR("p"))) {
+#if PROFILE_ISR
+        if (!skip_spaces(&cursor) || telemetry_get_format() != TELEMETRY_FORMAT_TEXT) {
+            return 0;
+        }
+        profile_dump();  // Dumps (and restarts) the ISR timing statistics
+        return 1;
+#else
+        return 0;
+#endif
+    }
+    if (match_word(&cursor, PSTR("tasks"))) {
+        if (!skip_spaces(&cursor) || telemetry_get_format() != TELEMETRY_FORMAT_TEXT) {
+            return 0;
+        }
+        sched_dump();  // Dumps (and restarts) the task statistics
+        return 1;
+    }
+    if (match_word(&cursor, PSTR("status"))) {
+        if (!skip_spaces(&cursor)) {
+            return 0;
+        }
+        *reply_length = command_status(reply);
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * Runs the command line received last, if any (main loop)
+ *
+ * The line is parsed straight out of the UART receive buffer and released
+ * afterwards, so USART_RX_vect can already collect the next one in the
+ * other buffer meanwhile.
+ */
+void command_service(void)
+{
+    const char *line = usart_rx_get_line();
+    char reply[COMMAND_REPLY_MAX];
+    uint8_t reply_length = 0;
+
+    if (line == 0) {
+        return;
+    }
+    if (command_execute(line, reply, &reply_length)) {
+        if (reply_length == 0) {
+            reply_length = append_text_P(reply, 0, PSTR("OK"));
+        }
+    } else {
+        reply_length = append_text_P(reply, 0, PSTR("ERR"));
+    }
+    usart_rx_release_line();
+    command_reply(reply, reply_length);
+}
@@ -0,0 +1,34 @@
+#ifndef COMMAND_H
+#define COMMAND_H
+
+#include <stdint.h>
+#include "config.h"
+
+/*
+ * Command channel on the UART receiver
+ *
+ * One command per line (CR or LF), words separated by spaces:
+ *
+ *   mode text|binary|waveform   report format (t, b, w for short)
+ *   samples <n>                 V/I pairs per sequence, 3..SAMPLE_BUFFER_SIZE
+ *   interval <ticks>            Timer1 ticks between conversions, 0 = follow the mains period
+ *   cal <v> <i>                 voltage and current gain trims, 10000 = 1.0
+ *   bright [<n>]                display brightness 1..DISPLAY_BRIGHTNESS_MAX, or the current level
+ *   prof                        ISR timing dump (PROFILE_ISR builds, p for short)
+ *   tasks                       task run times, overruns and idle share
+ *   status                      current settings
+ *
+ * Every command is answered with "OK", "ERR" or the status line: as text in
+ * the text format, as a TELEMETRY_FRAME_REPLY frame in the binary formats.
+ */
+
+// Reply text buffer, terminator included
+#define COMMAND_REPLY_MAX 64
+
+// Calibration trims on the command line are given in 1/CAL_TRIM_DECIMAL_ONE
+#define CAL_TRIM_DECIMAL_ONE 10000
+
+// Function declarations
+void command_service(void);
+
+#endif // COMMAND_H
@@ -32,9 +32,31 @@
 // UART CONFIGURATION
 // ============================================================================
 
-// UART Settings
-#define UART_BAUD_RATE 9600
-#define UART_BAUD_PRESCALER 12   // For 2MHz: 2000000/(16*9600) - 1 = 12.02 ≈ 12
+// UART Settings. UBRR0 and double-speed mode (U2X0) are derived from F_CPU in
+// uart.h; the build fails if no setting gets within UART_BAUD_MAX_ERROR.
+// Rates within 2% at 2 MHz: 9600, 19200, 125000, 250000.
+#ifndef UART_BAUD_RATE
+#define UART_BAUD_RATE 250000UL
+#endif
+#define UART_BAUD_MAX_ERROR 20   // Largest accepted baud rate error, 0.1 %
+
+// Transmit ring buffer drained by USART_UDRE_vect (power of two, at most 256;
+// one slot stays free). A full report is ~300 bytes, about 12 ms at 250 kbaud.
+#define UART_TX_BUFFER_SIZE 256
+
+// Receive buffer for one command line (command.c), terminator included;
+// longer lines are dropped
+#define UART_RX_LINE_MAX 32
+
+// Report format at boot (telemetry.h): TELEMETRY_FORMAT_TEXT, _BINARY or
+// _WAVEFORM; the "mode" command switches it at run time.
+#define TELEMETRY_FORMAT_DEFAULT TELEMETRY_FORMAT_TEXT
+
+// What usart_transmit() does when the ring buffer is full
+#define UART_TX_DROP_OLDEST 0    // Overwrite the oldest queued byte
+#define UART_TX_DROP_NEWEST 1    // Discard the new byte
+#define UART_TX_BLOCK       2    // Wait for USART_UDRE_vect to make room
+#define UART_TX_OVERFLOW_POLICY UART_TX_BLOCK
 
 // ============================================================================
 // DISPLAY CONFIGURATION
@@ -61,6 +83,26 @@
 #define SHIFT_LATCH_PIN     PC5      // Pin 28 - SH_ST (Storage Register Clock)
 #define SHIFT_LATCH_BIT     PC5
 
+// Display transport: how the segment byte gets into the 74HC595 on each refresh
+// BITBANG: shift_out_byte() clocks 8 bits out on SHIFT_DATA / SHIFT_CLOCK (PC4/PC3)
+//          inside TIMER0_COMPA_vect
+// SPI:     TIMER0_COMPA_vect only writes SPDR; the SPI master shifts the byte
+//          out and SPI_STC_vect latches it. Needs SH_DS on MOSI (PB3) and SH_CP
+//          on SCK (PB5) instead of PC4/PC3; the latch stays on SHIFT_LATCH.
+//          (The 328P's only USART is the serial link, so MSPIM is not an option.)
+// (may be overridden on the compiler command line)
+#define DISPLAY_TRANSPORT_BITBANG 0
+#define DISPLAY_TRANSPORT_SPI     1
+#ifndef DISPLAY_TRANSPORT
+#define DISPLAY_TRANSPORT DISPLAY_TRANSPORT_BITBANG
+#endif
+
+// SPI pins (SS is unused but must be an output, or a low level drops master mode)
+#define DISPLAY_SPI_DDR     DDRB
+#define DISPLAY_SPI_MOSI    PB3      // Pin 15 - to SH_DS
+#define DISPLAY_SPI_SCK     PB5      // Pin 17 - to SH_CP
+#define DISPLAY_SPI_SS      PB2      // Pin 14
+
 // Digit Enable Pins
 #define DIGIT_ENABLE_PORT PORTD
 #define DIGIT_ENABLE_DDR  DDRD
@@ -87,6 +129,24 @@
 #define DIGIT4_PIN      PD7      // Pin 11 - Ds4 (Fourth digit)
 #define DIGIT4_BIT      PD7
 
+// Multiplex refresh rate of the whole frame. Timer0 lights one digit per
+// compare match, so it fires DISPLAY_REFRESH_HZ * DISPLAY_DIGITS times a
+// second; timer.h derives the prescaler and OCR0A. 100 Hz and up does not
+// flicker on camera; each step up costs CPU time (see README).
+// (may be overridden on the compiler command line)
+#ifndef DISPLAY_REFRESH_HZ
+#define DISPLAY_REFRESH_HZ 125
+#endif
+
+// Brightness 1..DISPLAY_BRIGHTNESS_MAX: TIMER0_COMPB_vect blanks the digit
+// after level / DISPLAY_BRIGHTNESS_MAX of its slot (OCR0B). At the maximum
+// the digit stays lit for the whole slot and compare B is switched off.
+// Changed at run time with the "bright" command.
+#define DISPLAY_BRIGHTNESS_MAX 8
+#ifndef DISPLAY_BRIGHTNESS
+#define DISPLAY_BRIGHTNESS DISPLAY_BRIGHTNESS_MAX
+#endif
+
 
 // 7-segment display patterns (common cathode)
 #define SEG_A (1<<0)
@@ -108,6 +168,13 @@
 #define ZERO_CROSS_DDR DDRD
 #define ZERO_CROSS_PIN_REG PIND
 
+// Line-locked sampling: the sample interval is derived from the period
+// measured between INT0 edges so one sequence spans whole mains cycles
+#define LINE_FREQ_NOMINAL_HZ 50          // Assumed until a period has been measured
+#define LINE_FREQ_MIN_HZ 40              // Periods outside this range are ignored
+#define LINE_FREQ_MAX_HZ 70
+#define SAMPLE_CYCLES_PER_SEQUENCE 1     // Mains cycles covered by one sequence
+
 // ============================================================================
 // ENERGY MONITOR CONSTANTS
 // ============================================================================
@@ -115,12 +182,63 @@
 // Sampling and Processing
 #define SAMPLE_BUFFER_SIZE 37
 
-// Update Intervals
+// Sample accumulation mode
+// BUFFERED:  ADC_vect stores every sample, calculate_sample_metrics() walks the arrays
+// STREAMING: ADC_vect builds the sums sample by sample, no sample arrays in SRAM
+// (may be overridden on the compiler command line, as the host build does)
+#define ADC_ACCUM_BUFFERED  0
+#define ADC_ACCUM_STREAMING 1
+#ifndef ADC_ACCUMULATION_MODE
+#define ADC_ACCUMULATION_MODE ADC_ACCUM_BUFFERED
+#endif
+
+// Update Intervals (task periods on the Timer0 millisecond timebase, sched.c;
+// at most 32767 ms)
 #define DISPLAY_UPDATE_MS 1000
+#define DISPLAY_RENDER_LEAD_MS 100   // Scroll frames are formatted from the first sequence this close to the next step
+#define SCHED_EVENTLOG_MS 10     // Log output: the 256-byte TX buffer drains in ~10 ms at 250k
+#define SCHED_ENERGY_MS   1000   // Checks whether an EEPROM checkpoint is due
+
+// Deferred event log (eventlog.c): events up to LOG_LEVEL are compiled in.
+// Release builds (NDEBUG) keep warnings and errors; per-cycle DEBUG events
+// must be asked for explicitly, they are dropped when the UART falls behind.
+#define LOG_LEVEL_NONE  0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN  2
+#define LOG_LEVEL_INFO  3
+#define LOG_LEVEL_DEBUG 4
+#ifndef LOG_LEVEL
+#ifdef NDEBUG
+#define LOG_LEVEL LOG_LEVEL_WARN
+#else
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+#endif
+
+// ISR timing instrumentation (profile.c): min/avg/max duration and worst
+// entry latency per vector, sent over UART on the "prof" command
+#ifndef PROFILE_ISR
+#define PROFILE_ISR 0
+#endif
 
 // Hardware Scaling Factors
 #define VOLTAGE_DIVIDER_RATIO 21
 #define CURRENT_SHUNT_RESISTOR 0.545  // Ω
 #define CURRENT_OPAM_GAIN 2.10
 
+// ============================================================================
+// ENERGY ACCUMULATION
+// ============================================================================
+
+// Wear-levelled EEPROM checkpoints: ENERGY_EEPROM_SLOTS records of 13 bytes
+// rotate from ENERGY_EEPROM_BASE. 16 slots every 10 minutes keep each cell
+// far below the 100k write endurance for decades.
+#define ENERGY_EEPROM_BASE 0
+#define ENERGY_EEPROM_SLOTS 16
+#define ENERGY_CHECKPOINT_S 600
+
+// Longest gap between two measured sequences that is integrated as-is;
+// after a longer gap (no zero-crossings) only one sequence span is counted
+#define ENERGY_MAX_GAP_MS 1000
+
 #endif // CONFIG_H
\ No newline at end of file
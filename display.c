@@ -1,19 +1,73 @@
 #include "display.h"
 #include "powercalc.h"
 #include "config.h"
+#include "numfmt.h"
+#include "profile.h"
+#include "timer.h"
+#include <avr/pgmspace.h>
 #include <avr/interrupt.h>
 
-// 4 characters to be displayed on Ds1 to Ds4
-static volatile uint8_t disp_characters[4] = {0, 0, 0, 0};
-static volatile uint8_t disp_position = 0;
+// Per position Ds1 to Ds4, built once in init_display(): the DIGIT_ENABLE_PORT
+// image with only that digit's enable line low, and 0xFF at the first
+// position, where the multiplex ISR takes over the pending frame
+typedef struct {
+    uint8_t digit_select;
+    uint8_t frame_start;
+} display_digit_t;
+
+static display_digit_t display_digits[DISPLAY_DIGITS];
+static uint8_t disp_position = 0;   // Multiplex ISR only
+
+/*
+ * Segment frames, DISPLAY_DIGITS bytes each (Ds1 first)
+ *
+ * Two sets of the three scroll mode frames, rendered alternately after a
+ * sequence is reduced, and the fixed no-signal frame. Frames are named by
+ * their offset in display_frames[] (frame * DISPLAY_DIGITS). The ISR scans
+ * display_front and replaces it with display_pending only at the first
+ * digit, so a frame is never shown half old, half new. The renderer never
+ * writes the set holding display_front or display_pending.
+ */
+#define DISPLAY_SCROLL_MODES    3
+#define DISPLAY_FRAME_SETS      2
+#define DISPLAY_SET_SIZE        (DISPLAY_SCROLL_MODES * DISPLAY_DIGITS)
+#define DISPLAY_FRAME_NO_SIGNAL (DISPLAY_FRAME_SETS * DISPLAY_SET_SIZE)
+#define DISPLAY_FRAME_COUNT     (DISPLAY_FRAME_SETS * DISPLAY_SCROLL_MODES + 1)
+
+// Not volatile: a frame is only written while the ISR cannot reach it. The
+// single-byte display_pending store publishes it, and DISPLAY_BARRIER()
+// keeps the compiler from moving frame writes past that store or ahead of
+// the display_front read that picks the set to render
+#define DISPLAY_BARRIER() __asm__ __volatile__("" ::: "memory")
+static uint8_t display_frames[DISPLAY_FRAME_COUNT * DISPLAY_DIGITS];
+static volatile uint8_t display_front = 0;     // Frame being scanned (ISR)
+static volatile uint8_t display_pending = 0;   // Frame to show from the next digit 0 (main loop)
+
+// Renderer state (main loop): the set rendered last, whether it holds
+// current values, whether a scroll step has used it since, and when the
+// last scroll step was (timer0_get_ms())
+static uint8_t display_set = 0;
+static uint8_t display_set_valid = 0;
+static uint8_t display_render_due = 1;
+static uint16_t display_scroll_ms = 0;
+
+_Static_assert(DISPLAY_RENDER_LEAD_MS < DISPLAY_UPDATE_MS, "DISPLAY_RENDER_LEAD_MS must be shorter than a scroll step");
+
+// The position wraps with a mask, and one port write switches the digits
+_Static_assert((DISPLAY_DIGITS & (DISPLAY_DIGITS - 1)) == 0, "DISPLAY_DIGITS must be a power of two");
+_Static_assert(DIGIT_ENABLE_PINS == ((1 << DIGIT1_BIT) | (1 << DIGIT2_BIT) | (1 << DIGIT3_BIT) | (1 << DIGIT4_BIT)),
+    "DIGIT_ENABLE_PINS must list the four digit enable bits (all on DIGIT_ENABLE_PORT)");
+
+// Brightness level, 1..DISPLAY_BRIGHTNESS_MAX (display_set_brightness())
+static uint8_t display_brightness = DISPLAY_BRIGHTNESS_MAX;
 
 // Scrolling display variables
 static volatile uint8_t scroll_mode = 0;  // 0=avg_power, 1=rms_voltage, 2=peak_current
 static volatile uint32_t scroll_timer = 0;
 static volatile uint32_t last_scroll_update = 0;
 
-// 7-segment patterns for digits 0-9
-const uint8_t seg_pattern[10] = {
+// 7-segment patterns for digits 0-9 (flash, read with pgm_read_byte)
+const uint8_t seg_pattern[10] PROGMEM = {
     SEG_A | SEG_B | SEG_C | SEG_D | SEG_E | SEG_F,           // 0
     SEG_B | SEG_C,                                           // 1
     SEG_A | SEG_B | SEG_G | SEG_E | SEG_D,                   // 2
@@ -29,15 +83,26 @@ const uint8_t seg_pattern[10] = {
 // Display initialization
 void init_display(void)
 {
+#if DISPLAY_TRANSPORT == DISPLAY_TRANSPORT_SPI
+    // SPI master drives SH_DS (MOSI) and SH_CP (SCK): MSB first, mode 0
+    // (data valid on the rising SH_CP edge), SCK = F_CPU/2. The transfer
+    // complete interrupt latches each byte.
+    DISPLAY_SPI_DDR |= (1 << DISPLAY_SPI_MOSI) | (1 << DISPLAY_SPI_SCK) | (1 << DISPLAY_SPI_SS);
+    SPSR = (1 << SPI2X);
+    SPCR = (1 << SPIE) | (1 << SPE) | (1 << MSTR);
+#else
     // Configure shift register control pins as outputs
-    // SH_ST, SH_DS, SH_CP pins
+    // SH_DS, SH_CP pins
     SHIFT_CLOCK_DDR |= (1 << SHIFT_CLOCK_BIT);   // SH_CP (PC3) as output
     SHIFT_DATA_DDR |= (1 << SHIFT_DATA_BIT);     // SH_DS (PC4) as output  
-    SHIFT_LATCH_DDR |= (1 << SHIFT_LATCH_BIT);   // SH_ST (PC5) as output
-    
+
     // Initialize shift register pins to LOW
     SHIFT_CLOCK_PORT &= ~(1 << SHIFT_CLOCK_BIT);
     SHIFT_DATA_PORT &= ~(1 << SHIFT_DATA_BIT);
+#endif
+
+    // SH_ST (PC5) as output, LOW
+    SHIFT_LATCH_DDR |= (1 << SHIFT_LATCH_BIT);
     SHIFT_LATCH_PORT &= ~(1 << SHIFT_LATCH_BIT);
     
     // Configure digit selection pins as outputs
@@ -52,39 +117,98 @@ void init_display(void)
     DIGIT2_PORT |= (1 << DIGIT2_BIT);    // Ds2 = HIGH (disabled)
     DIGIT3_PORT |= (1 << DIGIT3_BIT);    // Ds3 = HIGH (disabled)
     DIGIT4_PORT |= (1 << DIGIT4_BIT);    // Ds4 = HIGH (disabled)
+
+    // Blank frames (the first one is shown until the first scroll step),
+    // four decimal points for "no signal"
+    for (uint8_t i = 0; i < sizeof(display_frames); i++) {
+        display_frames[i] = 0;
+    }
+    for (uint8_t position = 0; position < DISPLAY_DIGITS; position++) {
+        display_frames[DISPLAY_FRAME_NO_SIGNAL + position] = SEG_DP;
+        display_digits[position].frame_start = (position == 0) ? 0xFF : 0;
+    }
+    display_front = 0;
+    display_pending = 0;
+    display_set = 0;
+    display_set_valid = 0;
+    display_render_due = 1;
+
+    // The port image that enables each digit
+    display_digits[0].digit_select = DIGIT_ENABLE_PINS & ~(1 << DIGIT1_BIT);
+    display_digits[1].digit_select = DIGIT_ENABLE_PINS & ~(1 << DIGIT2_BIT);
+    display_digits[2].digit_select = DIGIT_ENABLE_PINS & ~(1 << DIGIT3_BIT);
+    display_digits[3].digit_select = DIGIT_ENABLE_PINS & ~(1 << DIGIT4_BIT);
+    disp_position = 0;
+
+    display_set_brightness(DISPLAY_BRIGHTNESS);
+}
+
+/*
+ * Sets the display brightness, 1..DISPLAY_BRIGHTNESS_MAX; returns 0 (and
+ * changes nothing) if 'level' is out of range
+ *
+ * Below the maximum, Timer0 compare B matches level / DISPLAY_BRIGHTNESS_MAX
+ * of the way into each multiplex slot and TIMER0_COMPB_vect switches the
+ * digit off until the next slot lights the next one. The digit only comes
+ * on once its byte is shifted out (~150 cycles into the slot with the
+ * bit-banged transport), so the lowest levels are somewhat dimmer than the
+ * ratio. At the maximum compare B is disabled: no blanking, no interrupt.
+ */
+uint8_t display_set_brightness(uint8_t level)
+{
+    if (level < 1 || level > DISPLAY_BRIGHTNESS_MAX) {
+        return 0;
+    }
+
+    uint8_t sreg = SREG;
+    cli();
+    if (level == DISPLAY_BRIGHTNESS_MAX) {
+        TIMSK0 &= ~(1 << OCIE0B);
+    } else {
+        OCR0B = (uint8_t)((TIMER0_COMPARE_VALUE + 1) * level / DISPLAY_BRIGHTNESS_MAX - 1);
+        TIFR0 = (1 << OCF0B);     // Drop a match left over from a previous setting
+        TIMSK0 |= (1 << OCIE0B);
+    }
+    display_brightness = level;
+    SREG = sreg;
+    return 1;
+}
+
+uint8_t display_get_brightness(void)
+{
+    return display_brightness;
 }
 // =============================================================================
 // SHIFT REGISTER CONTROL - HELPER FUNCTIONS
 // =============================================================================
 
+#if DISPLAY_TRANSPORT == DISPLAY_TRANSPORT_BITBANG
 /*
- * Shifts out one byte (8 bits) to the 74HC595 shift register
- * 
- * This function sends data serially to the shift register by:
- * 1. Setting the data pin (SH_DS) HIGH or LOW for each bit
- * 2. Pulsing the clock pin (SH_CP) to shift the bit into the register
- * 3. Repeating for all 8 bits, starting from MSB (bit 7) to LSB (bit 0)
- * 
+ * Shifts out one byte (8 bits) to the 74HC595 shift register, MSB first
+ * to match the segment wiring
+ *
+ * Each bit is two whole-port writes built from one snapshot of the port:
+ * data with the clock low, then the same with the clock high (the rising
+ * SH_CP edge shifts the bit in). The data level is a mask from the top
+ * bit, not a branch, so every byte takes the same number of cycles.
+ * SH_DS and SH_CP must share a port (PORTC); nothing else writes PORTC
+ * while the ISR runs.
+ *
  * @param data: 8-bit value representing segment pattern (a-g + decimal point)
- * 
- * Note: Data is sent MSB first to match the segment wiring
  */
-static void shift_out_byte(uint8_t data)
+static inline void shift_out_byte(uint8_t data)
 {
-    // Send 8 bits, starting from MSB (bit 7) down to LSB (bit 0)
-    for (int i = 7; i >= 0; i--) {
-        // Set data pin based on current bit value
-        if (data & (1 << i)) {
-            SHIFT_DATA_PORT |= (1 << SHIFT_DATA_BIT);   // Set data HIGH
-        } else {
-            SHIFT_DATA_PORT &= ~(1 << SHIFT_DATA_BIT);  // Set data LOW
-        }
-        
-        // Generate clock pulse to shift the bit into the register
-        SHIFT_CLOCK_PORT |= (1 << SHIFT_CLOCK_BIT);     // Clock HIGH
-        SHIFT_CLOCK_PORT &= ~(1 << SHIFT_CLOCK_BIT);    // Clock LOW
+    uint8_t idle = SHIFT_DATA_PORT & (uint8_t)~((1 << SHIFT_DATA_BIT) | (1 << SHIFT_CLOCK_BIT));
+
+    for (uint8_t bit = 0; bit < 8; bit++) {
+        uint8_t level = idle | ((uint8_t)-(data >> 7) & (1 << SHIFT_DATA_BIT));
+        SHIFT_DATA_PORT = level;                              // Data, clock LOW
+        SHIFT_DATA_PORT = level | (1 << SHIFT_CLOCK_BIT);     // Clock HIGH
+        data <<= 1;
     }
+    SHIFT_DATA_PORT = idle;
 }
+#endif
 
 /*
  * Latches (transfers) data from shift register to output pins
@@ -96,74 +220,27 @@ static void shift_out_byte(uint8_t data)
  * This function transfers data from stage 1 to stage 2 by pulsing SH_ST pin.
  * After latching, the new segment pattern becomes visible on the display.
  */
-static void latch_shift_register(void)
+static inline void latch_shift_register(void)
 {
     SHIFT_LATCH_PORT |= (1 << SHIFT_LATCH_BIT);        // Latch HIGH
     SHIFT_LATCH_PORT &= ~(1 << SHIFT_LATCH_BIT);       // Latch LOW
 }
 
 /*
- * Disables all 4 digit enable pins
- * 
- * Sets all digit select pins (Ds1-Ds4) to HIGH, which turns OFF all digits.
- * This prevents ghosting/bleeding between digits during multiplexing.
- * 
- * Should be called BEFORE changing segment data and BEFORE enabling a new digit.
- */
-static void disable_all_digits(void)
-{
-    DIGIT1_PORT |= (1 << DIGIT1_BIT);    // Ds1 = HIGH (disabled)
-    DIGIT2_PORT |= (1 << DIGIT2_BIT);    // Ds2 = HIGH (disabled)
-    DIGIT3_PORT |= (1 << DIGIT3_BIT);    // Ds3 = HIGH (disabled)
-    DIGIT4_PORT |= (1 << DIGIT4_BIT);    // Ds4 = HIGH (disabled)
-}
-
-/*
- * Enables a specific digit based on position
- * 
- * Sets the corresponding digit select pin to LOW, which turns ON that digit.
- * The segment data from the shift register will be displayed on this digit.
- * 
- * Digit mapping:
- * - Position 0 (Thousands) -> Ds1 (leftmost digit)
- * - Position 1 (Hundreds)  -> Ds2
- * - Position 2 (Tens)      -> Ds3
- * - Position 3 (Units)     -> Ds4 (rightmost digit)
- * 
- * @param position: Which digit to enable (0-3)
- */
-static void enable_digit(uint8_t position)
-{
-    switch (position) {
-        case 0:  // Thousands digit -> Ds1
-            DIGIT1_PORT &= ~(1 << DIGIT1_BIT);  // Ds1 = LOW (active)
-            break;
-        case 1:  // Hundreds digit -> Ds2
-            DIGIT2_PORT &= ~(1 << DIGIT2_BIT);  // Ds2 = LOW (active)
-            break;
-        case 2:  // Tens digit -> Ds3
-            DIGIT3_PORT &= ~(1 << DIGIT3_BIT);  // Ds3 = LOW (active)
-            break;
-        case 3:  // Units digit -> Ds4
-            DIGIT4_PORT &= ~(1 << DIGIT4_BIT);  // Ds4 = LOW (active)
-            break;
-    }
-}
-
-/*
- * Advances to the next digit position for multiplexing
- * 
- * Increments the display position counter (0 -> 1 -> 2 -> 3 -> 0 -> ...)
- * This creates a circular scanning pattern through all 4 digits.
- * 
- * Called after each digit is displayed to prepare for the next one.
+ * Shows the segments just shifted in on the current digit
+ *
+ * Latches them, then switches the digit enables with one masked write of
+ * DIGIT_ENABLE_PORT (previous digit off and this one on in the same write,
+ * the other port bits kept), and steps to the next position. Between the
+ * latch and the port write the previous digit shows the new segments for
+ * two or three cycles, about a microsecond of a 2 ms slot, which is not
+ * visible.
  */
-static void multiplexing_display(void)
+static inline void show_digit(uint8_t digit_select)
 {
-    disp_position++;
-    if (disp_position > 3) {
-        disp_position = 0;  // Wrap around to first digit
-    }
+    latch_shift_register();
+    DIGIT_ENABLE_PORT = (DIGIT_ENABLE_PORT & (uint8_t)~DIGIT_ENABLE_PINS) | digit_select;
+    disp_position = (disp_position + 1) & (DISPLAY_DIGITS - 1);
 }
 
 // =============================================================================
@@ -175,49 +252,59 @@ static void multiplexing_display(void)
  * 
  * This is the main function called from Timer ISR to implement display multiplexing.
  * It cycles through all 4 digits sequentially, displaying one digit at a time.
- * When called repeatedly at high frequency (e.g., every 1-5ms), persistence of
+ * When called repeatedly at high frequency (e.g., every 1-2.5ms), persistence of
  * vision makes all 4 digits appear to be lit simultaneously.
  * 
  * Operation sequence:
- * 1. Get segment pattern for current digit from buffer
- * 2. Send segment pattern to shift register
- * 3. Disable all digits (prevent ghosting)
- * 4. Latch new segment data to output
- * 5. Enable only the current digit
- * 6. Advance to next digit position
+ * 1. At the first position, take over the pending frame (a mask from the
+ *    position table, not a branch); read the segments of the current
+ *    position from the front frame, and its digit image
+ * 2. Send the segment byte to the shift register
+ * 3. Latch it and switch the digit enables in one port write (show_digit())
+ * 4. Advance to the next position
  * 
- * Called from: Timer ISR (typically every 1-5ms)
+ * No branches on the data or the position, so every refresh takes the same
+ * number of cycles (sim_bench checks the spread). With the SPI transport,
+ * steps 3-4 run in SPI_STC_vect once the byte has been shifted out.
  * 
- * Example timeline:
- * - Call 1: Display thousands digit (Ds1) with its segments
- * - Call 2: Display hundreds digit (Ds2) with its segments
- * - Call 3: Display tens digit (Ds3) with its segments
- * - Call 4: Display units digit (Ds4) with its segments
- * - Call 5: Back to thousands digit (cycle repeats)
+ * Called from: Timer ISR (TIMER0_SLOT_HZ, every 1-2.5ms)
  */
 void send_next_character_to_display(void)
 {
-    // Step 1: Get the segment pattern for the current digit position
-    uint8_t segments = disp_characters[disp_position];
-    
-    // Step 2: Send segment data to shift register (but not yet visible)
+    const display_digit_t *digit = &display_digits[disp_position];
+    uint8_t frame_start = digit->frame_start;
+    uint8_t front = (display_front & (uint8_t)~frame_start) | (display_pending & frame_start);
+
+    display_front = front;
+    uint8_t segments = display_frames[front + disp_position];
+
+#if DISPLAY_TRANSPORT == DISPLAY_TRANSPORT_SPI
+    SPDR = segments;
+#else
+    uint8_t digit_select = digit->digit_select;
+
     shift_out_byte(segments);
-    
-    // Step 3: Turn off all digits first to prevent ghosting
-    // (Important: Do this BEFORE latching new data)
-    disable_all_digits();
-    
-    // Step 4: Latch the new segment pattern to the output pins
-    // (Segments are now ready on the shift register outputs)
-    latch_shift_register();
-    
-    // Step 5: Enable only the current digit to show the new segments
-    // (Now the digit lights up with the correct pattern)
-    enable_digit(disp_position);
-    
-    // Step 6: Move to next digit for the next function call
-    multiplexing_display();
+    show_digit(digit_select);
+#endif
+}
+
+// Timer0 Compare B Interrupt - brightness: blanks the digit for the rest of
+// its slot (only enabled below DISPLAY_BRIGHTNESS_MAX)
+ISR(TIMER0_COMPB_vect)
+{
+    DIGIT_ENABLE_PORT |= DIGIT_ENABLE_PINS;
+}
+
+#if DISPLAY_TRANSPORT == DISPLAY_TRANSPORT_SPI
+// SPI Transfer Complete Interrupt - the segment byte is in the 74HC595:
+// latch it and light the digit it belongs to (steps 3-4 above)
+ISR(SPI_STC_vect)
+{
+    PROFILE_ISR_ENTER();
+    show_digit(display_digits[disp_position].digit_select);
+    PROFILE_ISR_EXIT(PROFILE_ID_SPI);
 }
+#endif
 
  
 // =============================================================================
@@ -225,13 +312,14 @@ void send_next_character_to_display(void)
 // =============================================================================
 
 /*
- * Populate the array 'disp_characters[]' by separating the four digits of 'number' 
+ * Populate the segment bytes of 'frame' (DISPLAY_DIGITS bytes) by separating the four digits of 'number' 
  * and then looking up the segment pattern from 'seg_pattern[]'
  * 
  * This function extracts individual digits from a number and converts them to 
  * 7-segment patterns. It also adds a decimal point at the specified position.
  * 
- * @param number: 16-bit number to display (0-9999)
+ * @param frame: frame to fill, not the one the multiplex ISR is scanning
+ * @param number: 16-bit number to display (0-9999; larger values show "----")
  * @param decimal_pos: Position of decimal point (0 = no decimal, 1-3 = after that digit from right)
  * 
  * Decimal point position examples:
@@ -246,28 +334,30 @@ void send_next_character_to_display(void)
  * - Position 2 (Ds3): Tens digit
  * - Position 3 (Ds4): Units digit (rightmost)
  */
-void seperate_and_load_characters(uint16_t number, uint8_t decimal_pos)
+void seperate_and_load_characters(uint8_t *frame, uint16_t number, uint8_t decimal_pos)
 {
-    uint8_t digit;
+    uint8_t digits[NUMFMT_MAX_DIGITS];
     
-    // Separate each digit from 'number' (e.g., 1230 yields '1', '2', '3', '0')
-    // Correct mapping: Ds4=units, Ds3=tens, Ds2=hundreds, Ds1=thousands
-    
-    // Thousands digit -> Ds1 (position 0)
-    digit = (number / 1000) % 10;
-    disp_characters[0] = seg_pattern[digit];
-    
-    // Hundreds digit -> Ds2 (position 1)
-    digit = (number / 100) % 10;
-    disp_characters[1] = seg_pattern[digit];
+    // Out of range: four dashes rather than the last four digits
+    if (number > DISPLAY_MAX_VALUE) {
+        for (uint8_t position = 0; position < DISPLAY_DIGITS; position++) {
+            frame[position] = SEG_G;
+        }
+        return;
+    }
     
-    // Tens digit -> Ds3 (position 2)
-    digit = (number / 10) % 10;
-    disp_characters[2] = seg_pattern[digit];
+    uint8_t significant = numfmt_digits(number, digits);
     
-    // Units digit -> Ds4 (position 3)
-    digit = number % 10;
-    disp_characters[3] = seg_pattern[digit];
+    // The last four digits map to Ds1..Ds4 (Ds4 = units). Leading zeros are
+    // blanked, except the digit left of the decimal point ("0.5", not " .5").
+    for (uint8_t position = 0; position < 4; position++) {
+        uint8_t from_right = 3 - position;
+        if (from_right < significant || from_right <= decimal_pos) {
+            frame[position] = pgm_read_byte(&seg_pattern[digits[NUMFMT_MAX_DIGITS - 4 + position]]);
+        } else {
+            frame[position] = 0;
+        }
+    }
     
     // Add decimal point if specified (decimal_pos counts from the right)
     // decimal_pos = 1: Add DP to units digit (position 3) - rightmost
@@ -283,7 +373,7 @@ void seperate_and_load_characters(uint16_t number, uint8_t decimal_pos)
         uint8_t dp_position = 4 - decimal_pos;  // Convert from right-count to position index
         
         // Add the decimal point segment to that digit
-        disp_characters[dp_position] |= SEG_DP;
+        frame[dp_position] |= SEG_DP;
     }
 }
 
@@ -293,48 +383,77 @@ void init_scrolling_display(void)
     scroll_mode = 0;
     scroll_timer = 0;
     last_scroll_update = 0;
+    display_scroll_ms = timer0_get_ms();
 }
 
-// Update scrolling display - call this every 1 second
+// Shows 'frame' (offset in display_frames[]) from the next first digit on
+static void display_show_frame(uint8_t frame)
+{
+    DISPLAY_BARRIER();  // Frame bytes are in memory before the ISR may read them
+    display_pending = frame;
+}
+
+/*
+ * Renders the frames of all three scroll modes from the latest results
+ * (main loop, after calculate_sample_metrics())
+ *
+ * Only once per scroll step, from the first sequence within
+ * DISPLAY_RENDER_LEAD_MS of the next one: the three numfmt_digits()
+ * conversions are not repeated for every mains cycle when at most one
+ * frame is shown per DISPLAY_UPDATE_MS, and the values are still fresh
+ * when they appear. The set not rendered last is the back set; the ISR
+ * left it at the first digit after the previous scroll step. Should it
+ * still be scanning it, nothing is rendered and the next sequence tries
+ * again.
+ */
+void display_render_frames(void)
+{
+    uint8_t back = display_set ^ 1;
+    uint8_t first = back * DISPLAY_SET_SIZE;
+
+    if (!display_render_due || !is_display_data_ready()
+        || (uint16_t)(timer0_get_ms() - display_scroll_ms) < DISPLAY_UPDATE_MS - DISPLAY_RENDER_LEAD_MS) {
+        return;
+    }
+    uint8_t front = display_front;
+    if (front >= first && front < first + DISPLAY_SET_SIZE) {
+        return;
+    }
+    DISPLAY_BARRIER();  // No frame write ahead of the check above
+
+    // Mode order as in update_scrolling_display()
+    seperate_and_load_characters(&display_frames[first], get_display_power(), 1);                        // 0.1 W
+    seperate_and_load_characters(&display_frames[first + DISPLAY_DIGITS], get_display_voltage(), 1);     // 0.1 V
+    seperate_and_load_characters(&display_frames[first + 2 * DISPLAY_DIGITS], get_display_current(), 3); // 1 mA, shown in A
+
+    display_set = back;
+    display_set_valid = 1;
+    display_render_due = 0;
+}
+
+/*
+ * Update scrolling display - call this every 1 second
+ *
+ * A scroll step only points the ISR at a frame display_render_frames()
+ * has already formatted, and asks for the next set.
+ */
 void update_scrolling_display(void)
 {
     // Check if display data is ready
-    if (is_display_data_ready()) {
-        // Show actual power data
-        uint16_t display_value;
-        uint8_t decimal_pos;
-        
-        switch (scroll_mode) {
-            case 0: // Average Power
-                display_value = (uint16_t)(get_display_power() * 10); // Show with 1 decimal place
-                decimal_pos = 1;
-                break;
-                
-            case 1: // RMS Voltage
-                display_value = (uint16_t)(get_display_voltage() * 10); // Show with 1 decimal place
-                decimal_pos = 1;
-                break;
-                
-            case 2: // Peak Current
-                display_value = (uint16_t)(get_display_current() * 100); // Show with 2 decimal places
-                decimal_pos = 2;
-                break;
-                
-            default:
-                display_value = 0;
-                decimal_pos = 0;
-                break;
-        }
-        
-        // Load the value to display
-        seperate_and_load_characters(display_value, decimal_pos);
+    if (is_display_data_ready() && display_set_valid) {
+        // Show actual power data: 0=avg_power, 1=rms_voltage, 2=peak_current
+        display_show_frame((uint8_t)(display_set * DISPLAY_SET_SIZE + scroll_mode * DISPLAY_DIGITS));
         
         // Move to next mode
-        scroll_mode = (scroll_mode + 1) % 3;
+        scroll_mode = (scroll_mode + 1) % DISPLAY_SCROLL_MODES;
     } else {
-        // Show "no signal" status (four decimal points)
+        // Show "no signal" status (four decimal points); the set rendered
+        // before the signal was lost is not shown again
         display_no_signal();
+        display_set_valid = 0;
     }
+    display_render_due = 1;
+    display_scroll_ms = timer0_get_ms();
 }
 
 // Get current scroll mode for external use
@@ -346,8 +465,5 @@ uint8_t get_scroll_mode(void)
 // Display "no signal" status (four decimal points)
 void display_no_signal(void)
 {
-    disp_characters[0] = SEG_DP;  // First digit: decimal point only
-    disp_characters[1] = SEG_DP;  // Second digit: decimal point only
-    disp_characters[2] = SEG_DP;  // Third digit: decimal point only
-    disp_characters[3] = SEG_DP;  // Fourth digit: decimal point only
+    display_show_frame(DISPLAY_FRAME_NO_SIGNAL);
 }
\ No newline at end of file
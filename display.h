@@ -7,6 +7,7 @@
 // Display Configuration
 #define DISPLAY_DIGITS 4
 #define DISPLAY_SEGMENTS 8
+#define DISPLAY_MAX_VALUE 9999   // Largest value seperate_and_load_characters() shows
 
 // Pin definitions for shift register control
 #define SHIFT_CLOCK_PORT PORTC
@@ -35,14 +36,16 @@
 void init_display(void);
 void display_update(void);
 void display_show_number(uint16_t number);
-void display_show_float(float value, uint8_t decimals);
 void display_clear(void);
 void display_set_digit(uint8_t digit, uint8_t value);
-void seperate_and_load_characters(uint16_t number, uint8_t decimal_pos);
+void seperate_and_load_characters(uint8_t *frame, uint16_t number, uint8_t decimal_pos);
 void send_next_character_to_display(void);
+uint8_t display_set_brightness(uint8_t level);
+uint8_t display_get_brightness(void);
 
 // Scrolling display functions
 void init_scrolling_display(void);
+void display_render_frames(void);
 void update_scrolling_display(void);
 uint8_t get_scroll_mode(void);
 void display_no_signal(void);
@@ -0,0 +1,205 @@
+#include "energy.h"
+#include "config.h"
+#include "timer.h"
+#include "eventlog.h"
+#include <avr/interrupt.h>
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+
+/*
+ * Cumulative energy with wear-levelled EEPROM checkpoints
+ *
+ * The accumulator counts mW·2^ENERGY_UNIT_SHIFT ticks in 64 bits. One
+ * measured cycle is a multiply-add and a shift, with the part below one
+ * unit carried to the next cycle, so nothing is lost and no division is
+ * needed. The range (~5 GWh, millennia at full scale) far outlasts the
+ * product; should it ever be reached the total saturates instead of
+ * wrapping to zero, since a wrapped total would be checkpointed too.
+ *
+ * Checkpoints rotate through ENERGY_EEPROM_SLOTS records. Each record holds
+ * a sequence number, the accumulator and a CRC-8; at boot the valid record
+ * with the newest sequence number wins, so a write torn by a power loss
+ * only costs the last checkpoint interval. Records are written one byte per
+ * EE_READY interrupt, and the main loop never waits on the ~3.4ms
+ * EEPROM write cycle.
+ */
+
+// Energy since first boot, in ENERGY_UNIT (mW·2^ENERGY_UNIT_SHIFT ticks),
+// and the mW·ticks not yet making up a whole unit
+static uint64_t energy_total = 0;
+static uint16_t energy_remainder = 0;
+
+// Checkpoint bookkeeping
+static uint32_t checkpoint_sequence = 0;
+static uint8_t checkpoint_slot = 0;
+static uint32_t last_checkpoint_ticks = 0;
+
+// Record being written by EE_READY_vect
+static uint8_t ee_record[ENERGY_RECORD_SIZE];
+static volatile uint16_t ee_address = 0;
+static volatile uint8_t ee_index = 0;
+static volatile uint8_t ee_busy = 0;
+
+// Little-endian record layout: [0..3] sequence, [4..11] energy, [12] CRC-8
+static void energy_pack_record(uint8_t *record, uint32_t sequence, uint64_t energy)
+{
+    uint8_t crc = 0;
+
+    for (uint8_t i = 0; i < 4; i++) {
+        record[i] = (uint8_t)(sequence >> (8 * i));
+    }
+    for (uint8_t i = 0; i < 8; i++) {
+        record[4 + i] = (uint8_t)(energy >> (8 * i));
+    }
+    for (uint8_t i = 0; i < ENERGY_RECORD_SIZE - 1; i++) {
+        crc = _crc8_ccitt_update(crc, record[i]);
+    }
+    record[ENERGY_RECORD_SIZE - 1] = crc;
+}
+
+// Returns 1 and fills sequence/energy if the record's CRC matches
+static uint8_t energy_unpack_record(const uint8_t *record, uint32_t *sequence, uint64_t *energy)
+{
+    uint8_t crc = 0;
+
+    for (uint8_t i = 0; i < ENERGY_RECORD_SIZE - 1; i++) {
+        crc = _crc8_ccitt_update(crc, record[i]);
+    }
+    if (crc != record[ENERGY_RECORD_SIZE - 1]) {
+        return 0;
+    }
+
+    *sequence = 0;
+    for (uint8_t i = 0; i < 4; i++) {
+        *sequence |= (uint32_t)record[i] << (8 * i);
+    }
+    *energy = 0;
+    for (uint8_t i = 0; i < 8; i++) {
+        *energy |= (uint64_t)record[4 + i] << (8 * i);
+    }
+
+    // An erased slot reads as all 0xFF
+    return (*sequence != 0xFFFFFFFFUL) ? 1 : 0;
+}
+
+static uint16_t energy_slot_address(uint8_t slot)
+{
+    return ENERGY_EEPROM_BASE + (uint16_t)slot * ENERGY_RECORD_SIZE;
+}
+
+// Restores the newest valid checkpoint (blocking EEPROM reads, call before sei())
+void energy_init(void)
+{
+    uint8_t record[ENERGY_RECORD_SIZE];
+    uint8_t found = 0;
+
+    energy_total = 0;
+    energy_remainder = 0;
+    checkpoint_sequence = 0;
+    checkpoint_slot = 0;
+
+    for (uint8_t slot = 0; slot < ENERGY_EEPROM_SLOTS; slot++) {
+        uint32_t sequence;
+        uint64_t energy;
+
+        eeprom_read_block(record, (const void *)(uintptr_t)energy_slot_address(slot), ENERGY_RECORD_SIZE);
+        if (!energy_unpack_record(record, &sequence, &energy)) {
+            continue;
+        }
+        // Serial-number comparison so the sequence may wrap
+        if (!found || (int32_t)(sequence - checkpoint_sequence) > 0) {
+            found = 1;
+            checkpoint_sequence = sequence;
+            checkpoint_slot = slot;
+            energy_total = energy;
+        }
+    }
+
+    // Next checkpoint goes to the slot after the newest one
+    if (found) {
+        LOG_INFO(EV_ENERGY_RESTORED, checkpoint_slot, (uint16_t)checkpoint_sequence, 0);
+        checkpoint_slot = (checkpoint_slot + 1) % ENERGY_EEPROM_SLOTS;
+    }
+    ee_busy = 0;
+    last_checkpoint_ticks = timer1_get_ticks32();
+}
+
+// Adds power_mW sustained for elapsed_ticks Timer1 ticks
+void energy_accumulate(uint32_t power_mW, uint32_t elapsed_ticks)
+{
+    uint64_t ticks_mW = (uint64_t)power_mW * elapsed_ticks + energy_remainder;
+    uint64_t units = ticks_mW >> ENERGY_UNIT_SHIFT;
+
+    energy_remainder = (uint16_t)(ticks_mW & ENERGY_UNIT_MASK);
+    energy_total += units;
+    if (energy_total < units) {
+        energy_total = UINT64_MAX;  // Saturate rather than wrap to zero
+    }
+}
+
+// Accumulated energy in ENERGY_UNIT (mW·2^ENERGY_UNIT_SHIFT ticks)
+uint64_t energy_get_total(void)
+{
+    return energy_total;
+}
+
+// Accumulated energy in mWh; the 32-bit value wraps every ~4.29 MWh
+uint32_t energy_get_mWh(void)
+{
+    return (uint32_t)(energy_total / ENERGY_UNITS_PER_MWH);
+}
+
+uint8_t energy_is_checkpoint_busy(void)
+{
+    return ee_busy;
+}
+
+/*
+ * Starts a checkpoint every ENERGY_CHECKPOINT_S seconds
+ *
+ * Only snapshots the accumulator and enables EE_READY; EE_READY_vect does
+ * the writing. Call from the main loop.
+ */
+void energy_service(void)
+{
+    uint32_t now = timer1_get_ticks32();
+
+    if (ee_busy || (now - last_checkpoint_ticks) < (uint32_t)ENERGY_CHECKPOINT_S * TIMER1_TICKS_PER_SECOND) {
+        return;
+    }
+    last_checkpoint_ticks = now;
+
+    checkpoint_sequence++;
+    energy_pack_record(ee_record, checkpoint_sequence, energy_total);
+    ee_address = energy_slot_address(checkpoint_slot);
+    ee_index = 0;
+    LOG_INFO(EV_ENERGY_CHECKPOINT, checkpoint_slot, (uint16_t)checkpoint_sequence, 0);
+    checkpoint_slot = (checkpoint_slot + 1) % ENERGY_EEPROM_SLOTS;
+
+    ee_busy = 1;
+    EECR |= (1 << EERIE);  // Fires as soon as the EEPROM is idle
+}
+
+// EEPROM Ready Interrupt Service Routine - writes the next changed byte of the record
+ISR(EE_READY_vect)
+{
+    while (ee_index < ENERGY_RECORD_SIZE) {
+        uint8_t data = ee_record[ee_index];
+
+        EEAR = ee_address + ee_index;
+        ee_index++;
+
+        // Unchanged bytes cost neither a write cycle nor wear
+        EECR |= (1 << EERE);
+        if (EEDR != data) {
+            EEDR = data;
+            EECR |= (1 << EEMPE);  // EEPE must follow within 4 cycles
+            EECR |= (1 << EEPE);
+            return;
+        }
+    }
+
+    // Record complete
+    EECR &= ~(1 << EERIE);
+    ee_busy = 0;
+}
@@ -0,0 +1,28 @@
+#ifndef ENERGY_H
+#define ENERGY_H
+
+#include <avr/io.h>
+#include <stdint.h>
+#include "config.h"
+
+// Energy accumulator unit: 1 mW for 2^ENERGY_UNIT_SHIFT Timer1 ticks
+// (1.024ms, ~1uJ at 2MHz); the 64-bit total then lasts ~5 GWh
+#define ENERGY_UNIT_SHIFT 11
+#define ENERGY_UNIT_MASK ((1UL << ENERGY_UNIT_SHIFT) - 1)
+#define ENERGY_UNITS_PER_MWH (((uint64_t)F_CPU * 3600ULL) >> ENERGY_UNIT_SHIFT)
+
+_Static_assert((((uint64_t)F_CPU * 3600ULL) & ENERGY_UNIT_MASK) == 0,
+    "One mWh must be a whole number of energy units");
+
+// Checkpoint record: sequence number, accumulator, CRC-8 over both
+#define ENERGY_RECORD_SIZE 13
+
+// Function declarations
+void energy_init(void);
+void energy_accumulate(uint32_t power_mW, uint32_t elapsed_ticks);
+uint64_t energy_get_total(void);
+uint32_t energy_get_mWh(void);
+void energy_service(void);
+uint8_t energy_is_checkpoint_busy(void);
+
+#endif // ENERGY_H
@@ -0,0 +1,191 @@
+#include "eventlog.h"
+#include "uart.h"
+#include "telemetry.h"
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+
+_Static_assert((EVENTLOG_QUEUE_SIZE & EVENTLOG_QUEUE_MASK) == 0 && EVENTLOG_QUEUE_SIZE <= 256,
+    "EVENTLOG_QUEUE_SIZE must be a power of two, at most 256");
+_Static_assert(EVENTLOG_LINE_MAX < UART_TX_BUFFER_SIZE, "UART_TX_BUFFER_SIZE cannot hold one event line");
+_Static_assert(EV_CODE_COUNT <= EVENTLOG_CODE_MASK + 1, "too many event codes for the packed code byte");
+
+/*
+ * Event queue
+ *
+ * Producers write at ev_head with interrupts disabled (always true in an
+ * ISR, a short cli() section in the main loop), so there is only ever one
+ * producer at a time. eventlog_service() is the only consumer and owns
+ * ev_tail; it reads the slot before publishing the new tail.
+ */
+static volatile eventlog_event_t ev_queue[EVENTLOG_QUEUE_SIZE];
+static volatile uint8_t ev_head = 0;
+static volatile uint8_t ev_tail = 0;
+static volatile uint16_t ev_lost = 0;     // Events dropped on a full queue
+static uint16_t ev_lost_reported = 0;
+
+// Argument format flags
+#define EV_ARG0        0x01
+#define EV_ARG0_SIGNED 0x02
+#define EV_ARG1        0x04
+#define EV_ARG1_SIGNED 0x08
+#define EV_TAG         0x10
+
+typedef struct {
+    const char *text;
+    uint8_t format;
+} eventlog_format_t;
+
+// Texts and table stay in flash (PROGMEM); eventlog_format() reads them with pgm_read_*
+static const char ev_text_sequence_start[] PROGMEM = "INT0 sequence start, period";
+static const char ev_text_cycle_dropped[] PROGMEM = "Cycle dropped, total";
+static const char ev_text_bank_ready[] PROGMEM = "ADC sample complete, bank";
+static const char ev_text_offset[] PROGMEM = "Offset";
+static const char ev_text_sample_raw[] PROGMEM = "Sample V_raw/I_raw";
+static const char ev_text_sample_centred[] PROGMEM = "Sample v/i";
+static const char ev_text_peak_current[] PROGMEM = "Peak current";
+static const char ev_text_energy_restored[] PROGMEM = "Energy restored, slot/seq";
+static const char ev_text_energy_checkpoint[] PROGMEM = "Energy checkpoint, slot/seq";
+static const char ev_text_log_overflow[] PROGMEM = "Log overflow, lost";
+
+static const eventlog_format_t ev_formats[EV_CODE_COUNT] PROGMEM = {
+    [EV_SEQUENCE_START]    = { ev_text_sequence_start, EV_ARG0 },
+    [EV_CYCLE_DROPPED]     = { ev_text_cycle_dropped, EV_ARG0 },
+    [EV_BANK_READY]        = { ev_text_bank_ready, EV_ARG0 },
+    [EV_OFFSET]            = { ev_text_offset, EV_ARG0 },
+    [EV_SAMPLE_RAW]        = { ev_text_sample_raw, EV_TAG | EV_ARG0 | EV_ARG1 },
+    [EV_SAMPLE_CENTRED]    = { ev_text_sample_centred, EV_TAG | EV_ARG0 | EV_ARG0_SIGNED | EV_ARG1 | EV_ARG1_SIGNED },
+    [EV_PEAK_CURRENT]      = { ev_text_peak_current, EV_ARG0 | EV_ARG0_SIGNED },
+    [EV_ENERGY_RESTORED]   = { ev_text_energy_restored, EV_TAG | EV_ARG0 },
+    [EV_ENERGY_CHECKPOINT] = { ev_text_energy_checkpoint, EV_TAG | EV_ARG0 },
+    [EV_LOG_OVERFLOW]      = { ev_text_log_overflow, EV_ARG0 },
+};
+
+static const char ev_level_letters[] PROGMEM = "-EWID";
+
+void eventlog_init(void)
+{
+    uint8_t sreg = SREG;
+    cli();
+    ev_head = 0;
+    ev_tail = 0;
+    ev_lost = 0;
+    SREG = sreg;
+    ev_lost_reported = 0;
+}
+
+// Queues one event; safe from ISRs and the main loop (use the LOG_* macros)
+void eventlog_push(uint8_t level, uint8_t code, uint8_t tag, uint16_t arg0, uint16_t arg1)
+{
+    uint8_t sreg = SREG;
+    cli();
+    uint8_t next = (ev_head + 1) & EVENTLOG_QUEUE_MASK;
+
+    if (next == ev_tail) {
+        ev_lost++;
+    } else {
+        volatile eventlog_event_t *event = &ev_queue[ev_head];
+        event->code_level = (uint8_t)((level << EVENTLOG_LEVEL_SHIFT) | code);
+        event->tag = tag;
+        event->arg0 = arg0;
+        event->arg1 = arg1;
+        ev_head = next;
+    }
+    SREG = sreg;
+}
+
+// Events dropped because the queue was full, since eventlog_init()
+uint16_t eventlog_get_lost(void)
+{
+    uint8_t sreg = SREG;
+    cli();
+    uint16_t lost = ev_lost;
+    SREG = sreg;
+    return lost;
+}
+
+static void eventlog_transmit_arg(uint16_t value, uint8_t is_signed)
+{
+    usart_transmit(' ');
+    if (is_signed) {
+        usart_transmit_signed((int16_t)value);
+    } else {
+        usart_transmit_number(value);
+    }
+}
+
+// One line per event: "[D] Offset 512"
+static void eventlog_format(const eventlog_event_t *event)
+{
+    uint8_t code = event->code_level & EVENTLOG_CODE_MASK;
+    uint8_t level = event->code_level >> EVENTLOG_LEVEL_SHIFT;
+    const char *text = pgm_read_ptr(&ev_formats[code].text);
+    uint8_t flags = pgm_read_byte(&ev_formats[code].format);
+
+    usart_transmit('[');
+    usart_transmit(pgm_read_byte(&ev_level_letters[level]));
+    usart_transmit_string_P(PSTR("] "));
+    usart_transmit_string_P(text);
+    if (flags & EV_TAG) {
+        eventlog_transmit_arg(event->tag, 0);
+    }
+    if (flags & EV_ARG0) {
+        eventlog_transmit_arg(event->arg0, flags & EV_ARG0_SIGNED);
+    }
+    if (flags & EV_ARG1) {
+        eventlog_transmit_arg(event->arg1, flags & EV_ARG1_SIGNED);
+    }
+    usart_transmit_string_P(PSTR("\r\n"));
+}
+
+// Sends one event as a text line or, in the binary formats, as an event frame.
+// Returns 0 if the UART has no room for it yet.
+static uint8_t eventlog_emit(const eventlog_event_t *event)
+{
+    if (telemetry_get_format() != TELEMETRY_FORMAT_TEXT) {
+        uint8_t payload[TELEMETRY_EVENT_SIZE] = {
+            event->code_level, event->tag,
+            (uint8_t)event->arg0, (uint8_t)(event->arg0 >> 8),
+            (uint8_t)event->arg1, (uint8_t)(event->arg1 >> 8),
+        };
+        return telemetry_send_frame(TELEMETRY_FRAME_EVENT, payload, sizeof(payload));
+    }
+    if (usart_tx_free() < EVENTLOG_LINE_MAX) {
+        return 0;
+    }
+    eventlog_format(event);
+    return 1;
+}
+
+/*
+ * Emits queued events (main loop only)
+ *
+ * Stops as soon as the transmit buffer could not take a whole line or
+ * frame, so it never blocks; the remaining events wait for the next call.
+ */
+void eventlog_service(void)
+{
+    uint16_t lost = eventlog_get_lost();
+
+    if (lost != ev_lost_reported) {
+        eventlog_event_t overflow = {
+            (uint8_t)((LOG_LEVEL_WARN << EVENTLOG_LEVEL_SHIFT) | EV_LOG_OVERFLOW),
+            0, (uint16_t)(lost - ev_lost_reported), 0
+        };
+        if (!eventlog_emit(&overflow)) {
+            return;
+        }
+        ev_lost_reported = lost;
+    }
+
+    while (ev_tail != ev_head) {
+        eventlog_event_t event;
+        event.code_level = ev_queue[ev_tail].code_level;
+        event.tag = ev_queue[ev_tail].tag;
+        event.arg0 = ev_queue[ev_tail].arg0;
+        event.arg1 = ev_queue[ev_tail].arg1;
+        if (!eventlog_emit(&event)) {
+            return;
+        }
+        ev_tail = (ev_tail + 1) & EVENTLOG_QUEUE_MASK;
+    }
+}
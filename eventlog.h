@@ -0,0 +1,77 @@
+#ifndef EVENTLOG_H
+#define EVENTLOG_H
+
+#include <avr/io.h>
+#include <stdint.h>
+#include "config.h"
+
+/*
+ * Deferred event log
+ *
+ * Producers (ISRs or the main loop) push fixed-size binary events into a
+ * small queue in a few cycles; eventlog_service() in the main loop formats
+ * them onto the UART later, only while the transmit buffer has room. Events
+ * above LOG_LEVEL (config.h) compile to nothing, arguments included.
+ */
+
+// Queue length in events (power of two, at most 256; one slot stays free)
+#define EVENTLOG_QUEUE_SIZE 16
+#define EVENTLOG_QUEUE_MASK (EVENTLOG_QUEUE_SIZE - 1)
+
+// Longest formatted line; eventlog_service() waits for this much TX space
+#define EVENTLOG_LINE_MAX 48
+
+// Event codes (names and argument formats in eventlog.c)
+#define EV_SEQUENCE_START    0   // arg0 = line period (ticks)
+#define EV_CYCLE_DROPPED     1   // arg0 = dropped cycles so far
+#define EV_BANK_READY        2   // arg0 = bank
+#define EV_OFFSET            3   // arg0 = offset (counts)
+#define EV_SAMPLE_RAW        4   // tag = index, arg0 = V raw, arg1 = I raw
+#define EV_SAMPLE_CENTRED    5   // tag = index, arg0 = v, arg1 = i (signed)
+#define EV_PEAK_CURRENT      6   // arg0 = peak current (signed counts)
+#define EV_ENERGY_RESTORED   7   // tag = slot, arg0 = checkpoint sequence (low 16 bits)
+#define EV_ENERGY_CHECKPOINT 8   // tag = slot, arg0 = checkpoint sequence (low 16 bits)
+#define EV_LOG_OVERFLOW      9   // arg0 = events lost
+#define EV_CODE_COUNT        10
+
+// Code in the low bits, level in the top three
+#define EVENTLOG_LEVEL_SHIFT 5
+#define EVENTLOG_CODE_MASK ((1 << EVENTLOG_LEVEL_SHIFT) - 1)
+
+typedef struct {
+    uint8_t code_level;
+    uint8_t tag;
+    uint16_t arg0;
+    uint16_t arg1;
+} eventlog_event_t;
+
+void eventlog_init(void);
+void eventlog_push(uint8_t level, uint8_t code, uint8_t tag, uint16_t arg0, uint16_t arg1);
+void eventlog_service(void);
+uint16_t eventlog_get_lost(void);
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(code, tag, arg0, arg1) eventlog_push(LOG_LEVEL_ERROR, (code), (tag), (arg0), (arg1))
+#else
+#define LOG_ERROR(code, tag, arg0, arg1) do { } while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(code, tag, arg0, arg1) eventlog_push(LOG_LEVEL_WARN, (code), (tag), (arg0), (arg1))
+#else
+#define LOG_WARN(code, tag, arg0, arg1) do { } while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(code, tag, arg0, arg1) eventlog_push(LOG_LEVEL_INFO, (code), (tag), (arg0), (arg1))
+#else
+#define LOG_INFO(code, tag, arg0, arg1) do { } while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(code, tag, arg0, arg1) eventlog_push(LOG_LEVEL_DEBUG, (code), (tag), (arg0), (arg1))
+#else
+#define LOG_DEBUG(code, tag, arg0, arg1) do { } while (0)
+#endif
+
+#endif // EVENTLOG_H
@@ -0,0 +1,63 @@
+#include "fixmath.h"
+
+/*
+ * Bit-by-bit square root core
+ *
+ * One result bit per iteration (at most 16), using only shifts, a compare
+ * and a subtract; no multiply or divide. Leaves floor(sqrt(x)) in *root and
+ * returns the remainder x - root².
+ */
+static uint32_t isqrt32_core(uint32_t x, uint32_t *root)
+{
+    uint32_t result = 0;
+    uint32_t bit = 1UL << 30;  // Highest power of four in range
+
+    while (bit > x) {
+        bit >>= 2;
+    }
+
+    while (bit != 0) {
+        if (x >= result + bit) {
+            x -= result + bit;
+            result = (result >> 1) + bit;
+        } else {
+            result >>= 1;
+        }
+        bit >>= 2;
+    }
+    *root = result;
+    return x;
+}
+
+/*
+ * Integer square root, rounded to nearest
+ *
+ * sqrt(x) >= r + 0.5 exactly when x - r² > r, so the remainder of the
+ * floor root decides the rounding without another multiply.
+ */
+uint16_t isqrt32(uint32_t x)
+{
+    uint32_t root;
+    uint32_t remainder = isqrt32_core(x, &root);
+
+    if (remainder > root && root < UINT16_MAX) {
+        root++;
+    }
+    return (uint16_t)root;
+}
+
+/*
+ * Square root with frac_bits fractional bits, rounded: sqrt(x) * 2^frac_bits
+ *
+ * Computed as isqrt32(x << 2*frac_bits), so x must be below
+ * 2^(32 - 2*frac_bits); larger inputs saturate.
+ */
+uint16_t isqrt32_frac(uint32_t x, uint8_t frac_bits)
+{
+    uint8_t shift = 2 * frac_bits;
+
+    if (shift != 0 && (x >> (32 - shift)) != 0) {
+        return UINT16_MAX;
+    }
+    return isqrt32(x << shift);
+}
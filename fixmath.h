@@ -0,0 +1,15 @@
+#ifndef FIXMATH_H
+#define FIXMATH_H
+
+#include <stdint.h>
+
+// Q-format constant from a compile-time expression: x * 2^frac_bits, rounded.
+// Only use with constant arguments so the compiler folds it to an integer
+// and no floating-point code is emitted.
+#define FIXMATH_Q(x, frac_bits) ((uint32_t)((x) * (double)(1UL << (frac_bits)) + 0.5))
+
+// Function declarations
+uint16_t isqrt32(uint32_t x);
+uint16_t isqrt32_frac(uint32_t x, uint8_t frac_bits);
+
+#endif // FIXMATH_H
@@ -0,0 +1,239 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <avr/interrupt.h>
+
+#include "hal_host.h"
+#include "config.h"
+#include "adc.h"
+#include "timer.h"
+#include "int0.h"
+#include "powercalc.h"
+#include "energy.h"
+
+/*
+ * Host benchmark of the measurement pipeline
+ *
+ * Replays synthetic mains cycles through the real firmware code paths:
+ * INT0_vect (edge timestamp, sequence start), ADC_vect (one call per
+ * conversion, plus the background offset conversion) and
+ * calculate_sample_metrics(). Two passes are made: an uninstrumented one
+ * for throughput, then one that brackets each stage with the host clock
+ * (calibrated overhead subtracted) for the per-stage split.
+ *
+ * Host nanoseconds do not translate to AVR cycles; use the numbers to
+ * compare two versions of an algorithm on the same machine.
+ *
+ * Usage: bench_pipeline [cycles]
+ */
+
+#define DEFAULT_CYCLES 2000000UL
+
+// Distinct synthetic waveforms, cycled through so the inputs keep changing
+#define WAVEFORM_COUNT 256
+
+typedef struct {
+    uint16_t voltage[SAMPLE_BUFFER_SIZE];
+    uint16_t current[SAMPLE_BUFFER_SIZE];
+    uint16_t offset;
+    uint16_t period_ticks;
+} waveform_t;
+
+typedef struct {
+    const char *name;
+    uint32_t calls_per_cycle;
+    double ns;
+} stage_t;
+
+static waveform_t waveforms[WAVEFORM_COUNT];
+
+// Fixed-seed LCG so every run sees the same input
+static uint32_t lcg_state = 12345;
+
+static int32_t lcg_noise(int32_t span)
+{
+    lcg_state = lcg_state * 1664525UL + 1013904223UL;
+    return (int32_t)((lcg_state >> 16) % (uint32_t)(2 * span + 1)) - span;
+}
+
+static uint16_t clamp_adc(double value)
+{
+    if (value < 0.0) {
+        return 0;
+    }
+    if (value > ADC_MAX_VALUE) {
+        return ADC_MAX_VALUE;
+    }
+    return (uint16_t)lround(value);
+}
+
+/*
+ * Fills the waveform table: voltage and current with varying amplitude,
+ * phase shift, a third harmonic on the current, a little noise and a line
+ * frequency wandering around nominal. Conversions alternate V, I at equal
+ * phase steps, as the line-locked sampling produces them.
+ */
+static void build_waveforms(void)
+{
+    const double slots = 2.0 * SAMPLE_BUFFER_SIZE;
+
+    for (uint16_t w = 0; w < WAVEFORM_COUNT; w++) {
+        waveform_t *wave = &waveforms[w];
+        double offset = 512.0 + lcg_noise(6);
+        double v_amp = 250.0 + (w % 16) * 10.0;
+        double i_amp = 20.0 + (w % 32) * 10.0;
+        double phi = (double)(w % 12) * M_PI / 24.0;
+        double freq_hz = LINE_FREQ_NOMINAL_HZ + (double)lcg_noise(50) / 100.0;
+
+        for (uint8_t k = 0; k < SAMPLE_BUFFER_SIZE; k++) {
+            double theta_v = 2.0 * M_PI * (2.0 * k) / slots;
+            double theta_i = 2.0 * M_PI * (2.0 * k + 1.0) / slots;
+            wave->voltage[k] = clamp_adc(offset + v_amp * sin(theta_v) + lcg_noise(2));
+            wave->current[k] = clamp_adc(offset + i_amp * sin(theta_i - phi)
+                + 0.1 * i_amp * sin(3.0 * (theta_i - phi)) + lcg_noise(2));
+        }
+        wave->offset = clamp_adc(offset + lcg_noise(1));
+        wave->period_ticks = (uint16_t)lround((double)F_CPU / freq_hz);
+    }
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+// Cost of one now_ns() bracket, subtracted from every timed stage
+static double timer_overhead_ns(void)
+{
+    const uint32_t rounds = 100000;
+    double total = 0.0;
+
+    for (uint32_t n = 0; n < rounds; n++) {
+        double t0 = now_ns();
+        total += now_ns() - t0;
+    }
+    return total / rounds;
+}
+
+static void pipeline_reset(void)
+{
+    hal_reset();
+    adc_init();
+    timer1_init();
+    int0_init();
+    powercalc_init();
+    energy_init();
+    sei();
+}
+
+// The conversions of one sequence: V/I pairs, then the offset reference
+static void feed_sequence(const waveform_t *wave)
+{
+    for (uint8_t k = 0; k < SAMPLE_BUFFER_SIZE; k++) {
+        hal_adc_complete(wave->voltage[k]);
+        hal_adc_complete(wave->current[k]);
+    }
+    hal_adc_complete(wave->offset);
+}
+
+// Main-loop side: reduce the bank ADC_vect handed over, then release it
+static void reduce_ready_bank(void)
+{
+    if (get_adc_sample_complete()) {
+        calculate_sample_metrics();
+        set_adc_sample_complete(0);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long cycles = DEFAULT_CYCLES;
+    uint64_t checksum = 0;
+    uint32_t edge_ticks = 0;
+
+    if (argc > 1) {
+        cycles = strtoul(argv[1], NULL, 10);
+        if (cycles == 0) {
+            fprintf(stderr, "usage: %s [cycles]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    build_waveforms();
+
+    // Pass 1: throughput, no instrumentation inside the loop
+    pipeline_reset();
+    double t_start = now_ns();
+    for (unsigned long c = 0; c < cycles; c++) {
+        const waveform_t *wave = &waveforms[c % WAVEFORM_COUNT];
+        edge_ticks += wave->period_ticks;
+        hal_int0_edge(edge_ticks);
+        feed_sequence(wave);
+        reduce_ready_bank();
+        checksum += get_average_power_mW() + get_rms_voltage_mV() + get_rms_current_dmA();
+    }
+    double total_ns = now_ns() - t_start;
+
+    // Pass 2: per-stage split
+    stage_t stages[] = {
+        { "INT0_vect", 1, 0.0 },
+        { "ADC_vect", ADC_CONVERSIONS_PER_SEQUENCE + 1, 0.0 },
+        { "calculate_sample_metrics", 1, 0.0 },
+    };
+    const uint8_t stage_count = sizeof(stages) / sizeof(stages[0]);
+    double overhead = timer_overhead_ns();
+
+    pipeline_reset();
+    edge_ticks = 0;
+    for (unsigned long c = 0; c < cycles; c++) {
+        const waveform_t *wave = &waveforms[c % WAVEFORM_COUNT];
+        edge_ticks += wave->period_ticks;
+
+        double t0 = now_ns();
+        hal_int0_edge(edge_ticks);
+        double t1 = now_ns();
+        feed_sequence(wave);
+        double t2 = now_ns();
+        reduce_ready_bank();
+        double t3 = now_ns();
+
+        stages[0].ns += t1 - t0 - overhead;
+        stages[1].ns += t2 - t1 - overhead;
+        stages[2].ns += t3 - t2 - overhead;
+    }
+
+    double cycles_per_s = (double)cycles / (total_ns * 1e-9);
+    double staged_ns = 0.0;
+    for (uint8_t s = 0; s < stage_count; s++) {
+        staged_ns += stages[s].ns;
+    }
+
+    printf("Accumulation mode : %s\n",
+        (ADC_ACCUMULATION_MODE == ADC_ACCUM_STREAMING) ? "streaming" : "buffered");
+    printf("Samples/sequence  : %u V/I pairs\n", SAMPLE_BUFFER_SIZE);
+    printf("Mains cycles      : %lu\n", cycles);
+    printf("Wall time         : %.3f s\n", total_ns * 1e-9);
+    printf("Throughput        : %.0f cycles/s (%.0fx real time at %u Hz)\n",
+        cycles_per_s, cycles_per_s / LINE_FREQ_NOMINAL_HZ, LINE_FREQ_NOMINAL_HZ);
+    printf("Per cycle         : %.1f ns\n\n", total_ns / cycles);
+
+    printf("%-26s %10s %12s %8s\n", "stage", "ns/call", "ns/cycle", "share");
+    for (uint8_t s = 0; s < stage_count; s++) {
+        double per_cycle = stages[s].ns / cycles;
+        printf("%-26s %10.1f %12.1f %7.1f%%\n", stages[s].name,
+            per_cycle / stages[s].calls_per_cycle, per_cycle,
+            (staged_ns > 0.0) ? 100.0 * stages[s].ns / staged_ns : 0.0);
+    }
+    printf("(clock overhead %.1f ns per bracket, subtracted)\n\n", overhead);
+
+    printf("Completed/dropped : %u / %u (16-bit counters)\n", adc_get_completed_cycles(), adc_get_dropped_cycles());
+    printf("Last P/V/Irms     : %lu mW, %lu mV, %u dmA\n",
+        (unsigned long)get_average_power_mW(), (unsigned long)get_rms_voltage_mV(), get_rms_current_dmA());
+    printf("Energy            : %lu mWh\n", (unsigned long)energy_get_mWh());
+    printf("Checksum          : %llu\n", (unsigned long long)checksum);
+    return 0;
+}
@@ -0,0 +1,131 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <util/crc16.h>
+
+#include "hal_host.h"
+#include "config.h"
+#include "energy.h"
+
+/*
+ * Host check of the energy accumulator at its boundaries
+ *
+ * Seeds the emulated EEPROM with checkpoint records, restores them with
+ * energy_init() and checks that the newest one is restored, that the
+ * sub-unit remainder is carried, that the total keeps counting past 2^64
+ * mW·ticks (~2.5 MWh, where a plain mW·tick sum would wrap) and that it
+ * saturates at the end of its range.
+ *
+ * Usage: energy_check (exit status 0 when every check passes)
+ */
+
+static unsigned failures = 0;
+
+#define CHECK(cond) check((cond), #cond, __LINE__)
+
+static void check(int ok, const char *what, int line)
+{
+    if (!ok) {
+        printf("FAIL line %d: %s\n", line, what);
+        failures++;
+    }
+}
+
+static void write_record(uint8_t slot, uint32_t sequence, uint64_t energy)
+{
+    uint8_t *record = &hal_eeprom[ENERGY_EEPROM_BASE + slot * ENERGY_RECORD_SIZE];
+    uint8_t crc = 0;
+
+    for (uint8_t i = 0; i < 4; i++) {
+        record[i] = (uint8_t)(sequence >> (8 * i));
+    }
+    for (uint8_t i = 0; i < 8; i++) {
+        record[4 + i] = (uint8_t)(energy >> (8 * i));
+    }
+    for (uint8_t i = 0; i < ENERGY_RECORD_SIZE - 1; i++) {
+        crc = _crc8_ccitt_update(crc, record[i]);
+    }
+    record[ENERGY_RECORD_SIZE - 1] = crc;
+}
+
+static void restore(uint32_t sequence, uint64_t energy)
+{
+    hal_reset();
+    write_record(0, sequence, energy);
+    energy_init();
+}
+
+// The newest record wins, also across a sequence wrap
+static void check_restore(void)
+{
+    hal_reset();
+    write_record(0, 7, 1000 * ENERGY_UNITS_PER_MWH);
+    write_record(1, 8, 2000 * ENERGY_UNITS_PER_MWH);
+    energy_init();
+    CHECK(energy_get_mWh() == 2000);
+
+    hal_reset();
+    write_record(0, 0xFFFFFFFEUL, 1 * ENERGY_UNITS_PER_MWH);
+    write_record(1, 0, 2 * ENERGY_UNITS_PER_MWH);
+    energy_init();
+    CHECK(energy_get_mWh() == 2);
+}
+
+// Products smaller than one unit still add up
+static void check_remainder(void)
+{
+    restore(1, 0);
+    for (uint32_t i = 0; i < (1UL << ENERGY_UNIT_SHIFT) - 1; i++) {
+        energy_accumulate(1, 1);
+    }
+    CHECK(energy_get_total() == 0);
+    energy_accumulate(1, 1);
+    CHECK(energy_get_total() == 1);
+
+    // One hour at 1 W, one 50 Hz cycle at a time
+    restore(1, 0);
+    for (uint32_t i = 0; i < 3600UL * 50; i++) {
+        energy_accumulate(1000, F_CPU / 50);
+    }
+    CHECK(energy_get_mWh() == 1000);
+}
+
+// A plain mW·tick sum would wrap at 2^64 (~2.56 MWh)
+static void check_tick_wrap(void)
+{
+    uint64_t tick_wrap = UINT64_MAX >> ENERGY_UNIT_SHIFT;
+    uint64_t before;
+
+    restore(1, tick_wrap - 1000);
+    before = energy_get_total();
+    // One minute at 3.68 kW (16 A at 230 V)
+    for (uint32_t i = 0; i < 60UL * 50; i++) {
+        energy_accumulate(3680000UL, F_CPU / 50);
+    }
+    CHECK(energy_get_total() > tick_wrap);
+    CHECK(energy_get_total() - before == 3680000ULL * F_CPU * 60 >> ENERGY_UNIT_SHIFT);
+}
+
+// The end of the range saturates instead of wrapping
+static void check_saturation(void)
+{
+    restore(1, UINT64_MAX - 10);
+    energy_accumulate(UINT32_MAX, UINT32_MAX);
+    CHECK(energy_get_total() == UINT64_MAX);
+    energy_accumulate(1000, F_CPU);
+    CHECK(energy_get_total() == UINT64_MAX);
+}
+
+int main(void)
+{
+    check_restore();
+    check_remainder();
+    check_tick_wrap();
+    check_saturation();
+
+    if (failures) {
+        printf("energy_check: %u failed\n", failures);
+        return 1;
+    }
+    printf("energy_check: ok\n");
+    return 0;
+}
@@ -0,0 +1,14 @@
+#ifndef SERIAL_PORT_H
+#define SERIAL_PORT_H
+
+#include <stdint.h>
+
+/*
+ * Opens 'path' for reading. Serial devices and ptys are switched to raw
+ * 8N1 at 'baud' (any rate, not just the standard ones); plain files and
+ * pipes are returned as they are. "-" is standard input. Returns the file
+ * descriptor, or -1 with errno set.
+ */
+int serial_open(const char *path, uint32_t baud);
+
+#endif // SERIAL_PORT_H
@@ -0,0 +1,557 @@
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <avr/interrupt.h>
+#include <util/crc16.h>
+
+#include "hal_host.h"
+#include "config.h"
+#include "adc.h"
+#include "timer.h"
+#include "int0.h"
+#include "powercalc.h"
+#include "energy.h"
+#include "telemetry.h"
+#include "serial_port.h"
+
+/*
+ * Telemetry decoder and waveform replay
+ *
+ * Reads the binary telemetry stream of one or more monitors (serial device,
+ * pty, capture file or "-" for stdin), splits it on the 0x00 delimiters,
+ * undoes the COBS encoding and checks the CRC-16 of every frame:
+ *
+ *   0x01 measurement  one output row per frame
+ *   0x02 event        printed to stderr
+ *   0x03 waveform     replayed through INT0_vect, ADC_vect and
+ *                     calculate_sample_metrics() of the host build, one
+ *                     output row per frame
+ *   0x04 reply        printed to stderr
+ *
+ * Gaps in the result sequence number of the report header are counted as
+ * missing results (not sent, or lost on the way).
+ *
+ * Inputs are decoded one after the other, each with a freshly reset
+ * measurement core, so the replayed energy total starts at zero for every
+ * capture. Replay uses the config.h calibration (trims 1.0), not whatever
+ * `cal` was set on the device. Text output between frames (the text format,
+ * or a mode switch mid-capture) shows up as framing errors.
+ *
+ * Output rows share one set of columns; 'kind' is "meas" or "replay".
+ * Sequence, timestamp and the completed/dropped/busy/stale counters come
+ * from the report header in both cases. time_s is the Timer1 timestamp
+ * unwrapped past its 32-bit range, in seconds since the device's Timer1
+ * started.
+ *
+ * Usage: telemetry_decode [-f csv|columns] [-b baud] [-q] [-s] input...
+ *   -f  output format (default csv)
+ *   -b  baud rate for serial devices (default UART_BAUD_RATE)
+ *   -q  do not print event and reply frames
+ *   -s  summary only, no rows
+ */
+
+#define READ_CHUNK 65536
+
+// Type + payload + CRC of the largest frame, and its COBS-encoded size
+#define FRAME_MAX (1 + TELEMETRY_MAX_PAYLOAD + 2)
+#define ENCODED_MAX (TELEMETRY_ENCODED_SIZE(1 + TELEMETRY_MAX_PAYLOAD) - 1)
+
+#define OUTPUT_CSV     0
+#define OUTPUT_COLUMNS 1
+
+typedef struct {
+    const char *name;
+
+    // Framing
+    uint64_t bytes;
+    uint64_t frames;
+    uint64_t frames_by_type[TELEMETRY_FRAME_REPLY + 1];
+    uint64_t framing_errors;   // COBS errors, overlong or too short frames
+    uint64_t crc_errors;
+    uint64_t bad_frames;       // Good CRC, unknown type or wrong length
+
+    // Result sequence check over measurement and waveform frames
+    uint8_t sequence_seen;
+    uint32_t sequence_next;
+    uint64_t results_missing;
+
+    // Timer1 timestamp unwrapping
+    uint8_t ticks_seen;
+    uint32_t ticks_last;
+    uint64_t ticks_high;
+
+    // Frame being collected
+    uint8_t encoded[ENCODED_MAX];
+    size_t encoded_length;
+    uint8_t overlong;
+} stream_t;
+
+typedef struct {
+    const char *kind;
+    uint32_t sequence;
+    uint32_t ticks;
+    double time_s;
+    uint16_t completed;
+    uint16_t dropped;
+    uint16_t busy;
+    uint16_t stale;
+    uint8_t flags;
+    uint32_t power_mW;
+    uint32_t voltage_mV;
+    uint16_t current_dmA;
+    uint16_t peak_dmA;
+    uint16_t offset_q;
+    uint16_t period_ticks;
+    uint32_t energy_mWh;
+} row_t;
+
+static uint16_t crc_table[256];
+static uint8_t output_format = OUTPUT_CSV;
+static uint8_t quiet = 0;
+static uint8_t summary_only = 0;
+static volatile sig_atomic_t interrupted = 0;
+
+static void on_interrupt(int signal_number)
+{
+    (void)signal_number;
+    interrupted = 1;
+}
+
+// Byte-wise table for the same CRC-16/XMODEM the firmware computes bit by bit
+static void crc_table_init(void)
+{
+    for (uint16_t n = 0; n < 256; n++) {
+        crc_table[n] = _crc_xmodem_update(0, (uint8_t)n);
+    }
+}
+
+static uint16_t crc_xmodem(const uint8_t *data, size_t length)
+{
+    uint16_t crc = 0;
+
+    for (size_t n = 0; n < length; n++) {
+        crc = (uint16_t)(crc << 8) ^ crc_table[(crc >> 8) ^ data[n]];
+    }
+    return crc;
+}
+
+static uint16_t get_u16(const uint8_t *buffer, size_t offset)
+{
+    return (uint16_t)(buffer[offset] | (buffer[offset + 1] << 8));
+}
+
+static uint32_t get_u32(const uint8_t *buffer, size_t offset)
+{
+    return get_u16(buffer, offset) | ((uint32_t)get_u16(buffer, offset + 2) << 16);
+}
+
+// Undoes COBS; returns the decoded length, or -1 if a code runs past the end
+static int cobs_decode(const uint8_t *in, size_t length, uint8_t *out)
+{
+    size_t read = 0;
+    size_t written = 0;
+
+    while (read < length) {
+        uint8_t code = in[read++];
+        if (read + code - 1 > length) {
+            return -1;
+        }
+        for (uint8_t n = 1; n < code; n++) {
+            out[written++] = in[read++];
+        }
+        // Every block but a full run or the last one stands for a zero
+        if (code != 0xFF && read < length) {
+            out[written++] = 0;
+        }
+    }
+    return (int)written;
+}
+
+static void pipeline_reset(void)
+{
+    hal_reset();
+    adc_init();
+    timer1_init();
+    int0_init();
+    powercalc_init();
+    energy_init();
+    sei();
+}
+
+// Seconds since the device's Timer1 started, across 32-bit wraps
+static double unwrap_ticks(stream_t *stream, uint32_t ticks)
+{
+    if (stream->ticks_seen && ticks < stream->ticks_last) {
+        stream->ticks_high += 1ULL << 32;
+    }
+    stream->ticks_seen = 1;
+    stream->ticks_last = ticks;
+    return (double)(stream->ticks_high + ticks) / F_CPU;
+}
+
+/*
+ * Reads the report header into 'row' and counts the results missing
+ * before its sequence number (a device reset restarts the count)
+ */
+static void parse_header(stream_t *stream, const uint8_t *payload, row_t *row)
+{
+    row->sequence = get_u32(payload, 0);
+    row->ticks = get_u32(payload, 4);
+    row->time_s = unwrap_ticks(stream, row->ticks);
+    row->completed = get_u16(payload, 8);
+    row->dropped = get_u16(payload, 10);
+    row->busy = get_u16(payload, 12);
+    row->stale = get_u16(payload, 14);
+
+    if (stream->sequence_seen && row->sequence > stream->sequence_next) {
+        stream->results_missing += row->sequence - stream->sequence_next;
+    }
+    stream->sequence_seen = 1;
+    stream->sequence_next = row->sequence + 1;
+}
+
+static void print_header(void)
+{
+    if (summary_only) {
+        return;
+    }
+    if (output_format == OUTPUT_CSV) {
+        printf("source,kind,seq,ticks,time_s,completed,dropped,busy,stale,flags,"
+               "power_mW,vrms_mV,irms_dmA,ipeak_dmA,offset_q6,period_ticks,energy_mWh\n");
+    } else {
+        printf("%-16s %-6s %10s %10s %12s %9s %7s %5s %5s %5s %10s %8s %6s %6s %6s %6s %10s\n",
+            "source", "kind", "seq", "ticks", "time_s", "completed", "dropped", "busy", "stale",
+            "flags", "power_mW", "vrms_mV", "irms", "ipeak", "offset", "period", "energy_mWh");
+    }
+}
+
+static void print_row(const stream_t *stream, const row_t *row)
+{
+    if (summary_only) {
+        return;
+    }
+    if (output_format == OUTPUT_CSV) {
+        printf("%s,%s,%lu,%lu,%.6f,%u,%u,%u,%u,0x%02x,%lu,%lu,%u,%u,%u,%u,%lu\n",
+            stream->name, row->kind, (unsigned long)row->sequence, (unsigned long)row->ticks,
+            row->time_s, row->completed, row->dropped, row->busy, row->stale,
+            row->flags, (unsigned long)row->power_mW, (unsigned long)row->voltage_mV,
+            row->current_dmA, row->peak_dmA, row->offset_q, row->period_ticks,
+            (unsigned long)row->energy_mWh);
+    } else {
+        printf("%-16s %-6s %10lu %10lu %12.6f %9u %7u %5u %5u  0x%02x %10lu %8lu %6u %6u %6u %6u %10lu\n",
+            stream->name, row->kind, (unsigned long)row->sequence, (unsigned long)row->ticks,
+            row->time_s, row->completed, row->dropped, row->busy, row->stale,
+            row->flags, (unsigned long)row->power_mW, (unsigned long)row->voltage_mV,
+            row->current_dmA, row->peak_dmA, row->offset_q, row->period_ticks,
+            (unsigned long)row->energy_mWh);
+    }
+}
+
+static uint8_t handle_measurement(stream_t *stream, const uint8_t *payload, size_t length)
+{
+    row_t row;
+
+    if (length != TELEMETRY_MEASUREMENT_SIZE) {
+        return 0;
+    }
+    row.kind = "meas";
+    parse_header(stream, payload, &row);
+    row.flags = payload[16];
+    row.power_mW = get_u32(payload, 17);
+    row.voltage_mV = get_u32(payload, 21);
+    row.current_dmA = get_u16(payload, 25);
+    row.peak_dmA = get_u16(payload, 27);
+    row.offset_q = get_u16(payload, 29);
+    row.period_ticks = get_u16(payload, 31);
+    row.energy_mWh = get_u32(payload, 33);
+    print_row(stream, &row);
+    return 1;
+}
+
+/*
+ * Unpacks a waveform frame and runs it through the measurement core as the
+ * device sampled it: INT0 edge at the frame's timestamp, V/I conversions,
+ * then the offset conversion, then the main-loop reduction
+ */
+static uint8_t handle_waveform(stream_t *stream, const uint8_t *payload, size_t length)
+{
+    uint16_t values[TELEMETRY_WAVEFORM_VALUES(SAMPLE_BUFFER_SIZE) + 3];
+    row_t row;
+
+    if (length < TELEMETRY_HEADER_SIZE + 1) {
+        return 0;
+    }
+    uint8_t samples = payload[TELEMETRY_HEADER_SIZE];
+    if (samples < ADC_MIN_SAMPLES || samples > SAMPLE_BUFFER_SIZE
+        || length != (size_t)TELEMETRY_WAVEFORM_SIZE(samples)) {
+        return 0;
+    }
+
+    uint16_t count = TELEMETRY_WAVEFORM_VALUES(samples);
+    const uint8_t *group = &payload[TELEMETRY_HEADER_SIZE + 1];
+    for (uint16_t n = 0; n < count; n += 4, group += 5) {
+        for (uint8_t slot = 0; slot < 4; slot++) {
+            values[n + slot] = group[slot] | (uint16_t)(((group[4] >> (2 * slot)) & 0x03) << 8);
+        }
+    }
+
+    row.kind = "replay";
+    parse_header(stream, payload, &row);
+
+    adc_set_sampling(samples, 0);
+    hal_int0_edge(row.ticks);
+    for (uint8_t k = 0; k < samples; k++) {
+        hal_adc_complete(values[k]);
+        hal_adc_complete(values[samples + k]);
+    }
+    hal_adc_complete(values[2 * samples]);
+    if (!get_adc_sample_complete()) {
+        return 0;
+    }
+    calculate_sample_metrics();
+    set_adc_sample_complete(0);
+
+    row.flags = TELEMETRY_FLAG_VALID;
+    row.power_mW = get_average_power_mW();
+    row.voltage_mV = get_rms_voltage_mV();
+    row.current_dmA = get_rms_current_dmA();
+    row.peak_dmA = get_peak_current_dmA();
+    row.offset_q = adc_get_offset_filtered();
+    row.period_ticks = int0_get_line_period();
+    row.energy_mWh = energy_get_mWh();
+    print_row(stream, &row);
+    return 1;
+}
+
+static uint8_t handle_event(stream_t *stream, const uint8_t *payload, size_t length)
+{
+    if (length != TELEMETRY_EVENT_SIZE) {
+        return 0;
+    }
+    if (!quiet) {
+        fprintf(stderr, "%s: event code %u level %u tag %u args %u %u\n", stream->name,
+            payload[0] & 0x1F, payload[0] >> 5, payload[1], get_u16(payload, 2), get_u16(payload, 4));
+    }
+    return 1;
+}
+
+static uint8_t handle_reply(stream_t *stream, const uint8_t *payload, size_t length)
+{
+    if (!quiet) {
+        fprintf(stderr, "%s: reply %.*s\n", stream->name, (int)length, (const char *)payload);
+    }
+    return 1;
+}
+
+// Decodes and dispatches the frame collected so far
+static void finish_frame(stream_t *stream)
+{
+    uint8_t frame[FRAME_MAX];
+
+    if (stream->overlong) {
+        stream->framing_errors++;
+        return;
+    }
+    if (stream->encoded_length == 0) {
+        return;  // Back-to-back delimiters carry nothing
+    }
+
+    int length = cobs_decode(stream->encoded, stream->encoded_length, frame);
+    if (length < 3) {
+        stream->framing_errors++;
+        return;
+    }
+    if (crc_xmodem(frame, (size_t)length - 2) != get_u16(frame, (size_t)length - 2)) {
+        stream->crc_errors++;
+        return;
+    }
+
+    uint8_t type = frame[0];
+    const uint8_t *payload = &frame[1];
+    size_t payload_length = (size_t)length - 3;
+    uint8_t ok = 0;
+
+    switch (type) {
+    case TELEMETRY_FRAME_MEASUREMENT:
+        ok = handle_measurement(stream, payload, payload_length);
+        break;
+    case TELEMETRY_FRAME_EVENT:
+        ok = handle_event(stream, payload, payload_length);
+        break;
+    case TELEMETRY_FRAME_WAVEFORM:
+        ok = handle_waveform(stream, payload, payload_length);
+        break;
+    case TELEMETRY_FRAME_REPLY:
+        ok = handle_reply(stream, payload, payload_length);
+        break;
+    default:
+        break;
+    }
+
+    if (ok) {
+        stream->frames++;
+        stream->frames_by_type[type]++;
+    } else {
+        stream->bad_frames++;
+    }
+}
+
+// Splits a chunk of the byte stream on the delimiters
+static void feed_bytes(stream_t *stream, const uint8_t *data, size_t length)
+{
+    stream->bytes += length;
+    for (size_t n = 0; n < length; n++) {
+        const uint8_t *end = memchr(&data[n], 0, length - n);
+        size_t run = end ? (size_t)(end - &data[n]) : length - n;
+
+        if (run > ENCODED_MAX - stream->encoded_length) {
+            stream->overlong = 1;
+        } else {
+            memcpy(&stream->encoded[stream->encoded_length], &data[n], run);
+            stream->encoded_length += run;
+        }
+        n += run;
+        if (end) {
+            finish_frame(stream);
+            stream->encoded_length = 0;
+            stream->overlong = 0;
+        }
+    }
+}
+
+static void print_summary(const stream_t *stream, double seconds)
+{
+    fprintf(stderr,
+        "%s: %llu bytes, %llu frames (measurement %llu, event %llu, waveform %llu, reply %llu), "
+        "%llu framing errors, %llu CRC errors, %llu bad frames, "
+        "%llu results missing, %.3f s (%.1f MB/s)\n",
+        stream->name, (unsigned long long)stream->bytes, (unsigned long long)stream->frames,
+        (unsigned long long)stream->frames_by_type[TELEMETRY_FRAME_MEASUREMENT],
+        (unsigned long long)stream->frames_by_type[TELEMETRY_FRAME_EVENT],
+        (unsigned long long)stream->frames_by_type[TELEMETRY_FRAME_WAVEFORM],
+        (unsigned long long)stream->frames_by_type[TELEMETRY_FRAME_REPLY],
+        (unsigned long long)stream->framing_errors, (unsigned long long)stream->crc_errors,
+        (unsigned long long)stream->bad_frames,
+        (unsigned long long)stream->results_missing,
+        seconds, (seconds > 0.0) ? (double)stream->bytes / seconds * 1e-6 : 0.0);
+}
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// Decodes one input to its end (or Ctrl-C); returns 0 if it could not be read
+static int decode_input(const char *path, uint32_t baud)
+{
+    static uint8_t chunk[READ_CHUNK];
+    static stream_t stream;
+    int fd = serial_open(path, baud);
+    uint8_t live;
+
+    if (fd < 0) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return 0;
+    }
+    live = (uint8_t)isatty(fd);
+
+    memset(&stream, 0, sizeof(stream));
+    stream.name = path;
+    pipeline_reset();
+
+    double t_start = now_s();
+    while (!interrupted) {
+        ssize_t got = read(fd, chunk, sizeof(chunk));
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got < 0) {
+            fprintf(stderr, "%s: %s\n", path, strerror(errno));
+            break;
+        }
+        if (got == 0) {
+            break;
+        }
+        feed_bytes(&stream, chunk, (size_t)got);
+        if (live) {
+            fflush(stdout);
+        }
+    }
+    double seconds = now_s() - t_start;
+
+    if (fd != STDIN_FILENO) {
+        close(fd);
+    }
+    fflush(stdout);
+    print_summary(&stream, seconds);
+    return 1;
+}
+
+static void usage(const char *program)
+{
+    fprintf(stderr, "usage: %s [-f csv|columns] [-b baud] [-q] [-s] input...\n", program);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t baud = UART_BAUD_RATE;
+    struct sigaction action;
+    int status = 0;
+    int option;
+
+    while ((option = getopt(argc, argv, "f:b:qs")) != -1) {
+        switch (option) {
+        case 'f':
+            if (strcmp(optarg, "csv") == 0) {
+                output_format = OUTPUT_CSV;
+            } else if (strcmp(optarg, "columns") == 0) {
+                output_format = OUTPUT_COLUMNS;
+            } else {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'b':
+            baud = (uint32_t)strtoul(optarg, NULL, 10);
+            if (baud == 0) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'q':
+            quiet = 1;
+            break;
+        case 's':
+            summary_only = 1;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (optind >= argc) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    // Ctrl-C ends a live capture with the summary instead of killing it
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = on_interrupt;
+    sigaction(SIGINT, &action, NULL);
+
+    crc_table_init();
+    print_header();
+    for (int n = optind; n < argc && !interrupted; n++) {
+        if (!decode_input(argv[n], baud)) {
+            status = 1;
+        }
+    }
+    return status;
+}
@@ -0,0 +1,10 @@
+#ifndef HOST_AVR_EEPROM_H
+#define HOST_AVR_EEPROM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Blocking EEPROM read from the emulated array in hal_host.c
+void eeprom_read_block(void *dst, const void *src, size_t n);
+
+#endif // HOST_AVR_EEPROM_H
@@ -0,0 +1,18 @@
+#ifndef HOST_AVR_INTERRUPT_H
+#define HOST_AVR_INTERRUPT_H
+
+#include <avr/io.h>
+
+/*
+ * Host stand-in for <avr/interrupt.h>
+ *
+ * An ISR becomes an ordinary function named after its vector, which the
+ * harness calls to "fire" the interrupt. sei()/cli() only track the I bit
+ * in SREG so the firmware's save/restore pattern behaves as on the target.
+ */
+#define ISR(vector, ...) void vector(void); void vector(void)
+
+#define sei() (SREG |= 0x80)
+#define cli() (SREG &= (uint8_t)~0x80)
+
+#endif // HOST_AVR_INTERRUPT_H
@@ -0,0 +1,163 @@
+#ifndef HOST_AVR_IO_H
+#define HOST_AVR_IO_H
+
+#include <stdint.h>
+
+/*
+ * Host stand-in for <avr/io.h>
+ *
+ * Every I/O register the firmware touches is a plain volatile variable
+ * (defined in hal_host.c), so the unmodified sources compile and run on a
+ * PC. Only the registers and bit names used by this project are listed;
+ * the numbering matches the ATmega328P data sheet.
+ */
+
+#define HOST_REG8(name)  extern volatile uint8_t name;
+#define HOST_REG16(name) extern volatile uint16_t name;
+
+// ADC
+HOST_REG8(ADMUX) HOST_REG8(ADCSRA) HOST_REG8(ADCSRB) HOST_REG16(ADC) HOST_REG8(DIDR0)
+// Timer0 / Timer1
+HOST_REG8(TCCR0A) HOST_REG8(TCCR0B) HOST_REG8(TCNT0) HOST_REG8(OCR0A) HOST_REG8(OCR0B)
+HOST_REG8(TIMSK0) HOST_REG8(TIFR0)
+HOST_REG8(TCCR1A) HOST_REG8(TCCR1B) HOST_REG16(TCNT1) HOST_REG16(OCR1A) HOST_REG16(OCR1B)
+HOST_REG8(TIMSK1) HOST_REG8(TIFR1)
+// USART0
+HOST_REG8(UBRR0H) HOST_REG8(UBRR0L) HOST_REG8(UCSR0A) HOST_REG8(UCSR0B) HOST_REG8(UCSR0C)
+HOST_REG8(UDR0)
+// GPIO
+HOST_REG8(PORTB) HOST_REG8(DDRB) HOST_REG8(PINB)
+HOST_REG8(PORTC) HOST_REG8(DDRC) HOST_REG8(PINC)
+HOST_REG8(PORTD) HOST_REG8(DDRD) HOST_REG8(PIND)
+// External interrupts
+HOST_REG8(EICRA) HOST_REG8(EIMSK) HOST_REG8(EIFR)
+// EEPROM
+HOST_REG16(EEAR) HOST_REG8(EEDR) HOST_REG8(EECR)
+// SPI
+HOST_REG8(SPCR) HOST_REG8(SPSR) HOST_REG8(SPDR)
+// Core
+HOST_REG8(SMCR) HOST_REG8(SREG)
+
+// ADMUX / ADCSRA / ADCSRB
+#define REFS1 7
+#define REFS0 6
+#define ADLAR 5
+#define ADEN 7
+#define ADSC 6
+#define ADATE 5
+#define ADIF 4
+#define ADIE 3
+#define ADPS2 2
+#define ADPS1 1
+#define ADPS0 0
+#define ADTS2 2
+#define ADTS1 1
+#define ADTS0 0
+
+// Timer0
+#define WGM01 1
+#define WGM00 0
+#define WGM02 3
+#define CS02 2
+#define CS01 1
+#define CS00 0
+#define OCIE0B 2
+#define OCIE0A 1
+#define TOIE0 0
+#define OCF0B 2
+#define OCF0A 1
+#define TOV0 0
+
+// Timer1
+#define WGM13 4
+#define WGM12 3
+#define WGM11 1
+#define WGM10 0
+#define CS12 2
+#define CS11 1
+#define CS10 0
+#define OCIE1B 2
+#define OCIE1A 1
+#define TOIE1 0
+#define OCF1B 2
+#define OCF1A 1
+#define TOV1 0
+
+// USART0
+#define RXC0 7
+#define TXC0 6
+#define UDRE0 5
+#define FE0 4
+#define DOR0 3
+#define UPE0 2
+#define U2X0 1
+#define RXCIE0 7
+#define TXCIE0 6
+#define UDRIE0 5
+#define RXEN0 4
+#define TXEN0 3
+#define UCSZ02 2
+#define UMSEL01 7
+#define UMSEL00 6
+#define UCSZ01 2
+#define UCSZ00 1
+#define UCPOL0 0
+
+// External interrupts
+#define ISC01 1
+#define ISC00 0
+#define INT0 0
+#define INTF0 0
+
+// EEPROM
+#define EERIE 3
+#define EEMPE 2
+#define EEPE 1
+#define EERE 0
+
+// SPI
+#define SPIE 7
+#define SPE 6
+#define DORD 5
+#define MSTR 4
+#define CPOL 3
+#define CPHA 2
+#define SPR1 1
+#define SPR0 0
+#define SPIF 7
+#define SPI2X 0
+
+// Sleep
+#define SM2 3
+#define SM1 2
+#define SM0 1
+#define SE 0
+
+// SREG
+#define SREG_I 7
+
+// Port pins
+#define PB0 0
+#define PB1 1
+#define PB2 2
+#define PB3 3
+#define PB4 4
+#define PB5 5
+#define PC0 0
+#define PC1 1
+#define PC2 2
+#define PC3 3
+#define PC4 4
+#define PC5 5
+#define PD0 0
+#define PD1 1
+#define PD2 2
+#define PD3 3
+#define PD4 4
+#define PD5 5
+#define PD6 6
+#define PD7 7
+
+#define E2END 0x3FF
+
+#endif // HOST_AVR_IO_H
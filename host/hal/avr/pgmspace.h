@@ -0,0 +1,20 @@
+#ifndef HOST_AVR_PGMSPACE_H
+#define HOST_AVR_PGMSPACE_H
+
+#include <stdint.h>
+
+/*
+ * Host stand-in for <avr/pgmspace.h>
+ *
+ * There is a single address space on the host, so PROGMEM data stays where
+ * the compiler puts it and the pgm_read_* accessors are plain loads.
+ */
+#define PROGMEM
+#define PSTR(s) (s)
+
+#define pgm_read_byte(address) (*(const uint8_t *)(address))
+#define pgm_read_word(address) (*(const uint16_t *)(address))
+#define pgm_read_dword(address) (*(const uint32_t *)(address))
+#define pgm_read_ptr(address) (*(const void *const *)(address))
+
+#endif // HOST_AVR_PGMSPACE_H
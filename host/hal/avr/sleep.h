@@ -0,0 +1,21 @@
+#ifndef HOST_AVR_SLEEP_H
+#define HOST_AVR_SLEEP_H
+
+#include <avr/io.h>
+
+/*
+ * Host stand-in for <avr/sleep.h>
+ *
+ * The mode and enable bits land in SMCR as on the target; sleep_cpu()
+ * returns at once, as if an interrupt had woken the CPU.
+ */
+#define SLEEP_MODE_IDLE         0
+#define SLEEP_MODE_ADC          (1 << SM0)
+#define SLEEP_MODE_PWR_DOWN     (1 << SM1)
+
+#define set_sleep_mode(mode) (SMCR = (uint8_t)((SMCR & ~((1 << SM2) | (1 << SM1) | (1 << SM0))) | (mode)))
+#define sleep_enable()  (SMCR |= (1 << SE))
+#define sleep_disable() (SMCR &= (uint8_t)~(1 << SE))
+#define sleep_cpu()     do { } while (0)
+
+#endif // HOST_AVR_SLEEP_H
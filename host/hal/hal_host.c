@@ -0,0 +1,97 @@
+#include "hal_host.h"
+#include <avr/eeprom.h>
+#include <string.h>
+
+// Register storage for avr/io.h
+#undef HOST_REG8
+#undef HOST_REG16
+#define HOST_REG8(name)  volatile uint8_t name;
+#define HOST_REG16(name) volatile uint16_t name;
+
+HOST_REG8(ADMUX) HOST_REG8(ADCSRA) HOST_REG8(ADCSRB) HOST_REG16(ADC) HOST_REG8(DIDR0)
+HOST_REG8(TCCR0A) HOST_REG8(TCCR0B) HOST_REG8(TCNT0) HOST_REG8(OCR0A) HOST_REG8(OCR0B)
+HOST_REG8(TIMSK0) HOST_REG8(TIFR0)
+HOST_REG8(TCCR1A) HOST_REG8(TCCR1B) HOST_REG16(TCNT1) HOST_REG16(OCR1A) HOST_REG16(OCR1B)
+HOST_REG8(TIMSK1) HOST_REG8(TIFR1)
+HOST_REG8(UBRR0H) HOST_REG8(UBRR0L) HOST_REG8(UCSR0A) HOST_REG8(UCSR0B) HOST_REG8(UCSR0C)
+HOST_REG8(UDR0)
+HOST_REG8(PORTB) HOST_REG8(DDRB) HOST_REG8(PINB)
+HOST_REG8(PORTC) HOST_REG8(DDRC) HOST_REG8(PINC)
+HOST_REG8(PORTD) HOST_REG8(DDRD) HOST_REG8(PIND)
+HOST_REG8(EICRA) HOST_REG8(EIMSK) HOST_REG8(EIFR)
+HOST_REG16(EEAR) HOST_REG8(EEDR) HOST_REG8(EECR)
+HOST_REG8(SPCR) HOST_REG8(SPSR) HOST_REG8(SPDR)
+HOST_REG8(SMCR) HOST_REG8(SREG)
+
+uint8_t hal_eeprom[E2END + 1];
+
+// Timer1 overflows replayed so far by hal_int0_edge()
+static uint16_t hal_timer1_overflows = 0;
+
+void hal_reset(void)
+{
+    UCSR0A = (1 << UDRE0);
+    SREG = 0;
+    TCNT1 = 0;
+    hal_timer1_overflows = 0;
+    memset(hal_eeprom, 0xFF, sizeof(hal_eeprom));
+}
+
+void eeprom_read_block(void *dst, const void *src, size_t n)
+{
+    uintptr_t address = (uintptr_t)src;
+
+    if (address > E2END || n > (size_t)(E2END + 1 - address)) {
+        memset(dst, 0xFF, n);
+        return;
+    }
+    memcpy(dst, &hal_eeprom[address], n);
+}
+
+void hal_adc_complete(uint16_t result)
+{
+    ADC = result;
+    ADCSRA &= (uint8_t)~((1 << ADSC) | (1 << ADIF));
+    ADC_vect();
+}
+
+size_t hal_uart_drain(uint8_t *out, size_t max)
+{
+    size_t sent = 0;
+
+    while (UCSR0B & (1 << UDRIE0)) {
+        USART_UDRE_vect();
+        if (!(UCSR0B & (1 << UDRIE0))) {
+            break;  // Queue was empty: the ISR disabled itself, nothing sent
+        }
+        if (out && sent < max) {
+            out[sent] = UDR0;
+        }
+        sent++;
+    }
+    return sent;
+}
+
+void hal_uart_receive(uint8_t data)
+{
+    if (!(UCSR0B & (1 << RXCIE0))) {
+        return;
+    }
+    UDR0 = data;
+    UCSR0A |= (1 << RXC0);
+    USART_RX_vect();
+    UCSR0A &= (uint8_t)~(1 << RXC0);
+}
+
+void hal_int0_edge(uint32_t ticks)
+{
+    uint16_t overflows = (uint16_t)(ticks >> 16);
+
+    TCNT1 = (uint16_t)ticks;
+    TIFR1 &= (uint8_t)~(1 << TOV1);
+    while (hal_timer1_overflows != overflows) {
+        TIMER1_OVF_vect();
+        hal_timer1_overflows++;
+    }
+    INT0_vect();
+}
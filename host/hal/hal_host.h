@@ -0,0 +1,56 @@
+#ifndef HAL_HOST_H
+#define HAL_HOST_H
+
+#include <avr/io.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Host register HAL
+ *
+ * The firmware sources are compiled unchanged against the stand-in headers
+ * in this directory. This header is for the host programs only: it exposes
+ * the interrupt vectors as callable functions and a few helpers that play
+ * the part of the peripherals.
+ */
+
+// Interrupt vectors defined by the firmware (see avr/interrupt.h)
+void ADC_vect(void);
+void INT0_vect(void);
+void TIMER0_COMPA_vect(void);
+void TIMER0_COMPB_vect(void);
+void SPI_STC_vect(void);
+void TIMER1_OVF_vect(void);
+void EE_READY_vect(void);
+void USART_UDRE_vect(void);
+void USART_RX_vect(void);
+
+// Emulated EEPROM contents (erased state is 0xFF)
+extern uint8_t hal_eeprom[E2END + 1];
+
+// Power-on register state: UDRE0 set so UART writes never block
+void hal_reset(void);
+
+/*
+ * Completes the pending ADC conversion with 'result' and runs ADC_vect
+ *
+ * Conversions only finish when the harness says so. adc_start_sequence()
+ * waits for a pending offset conversion, so complete that one before the
+ * next INT0 edge, as the real ADC would have done by then.
+ */
+void hal_adc_complete(uint16_t result);
+
+/*
+ * Runs USART_UDRE_vect while it is enabled, as if the transmitter were
+ * infinitely fast, and copies up to 'max' sent bytes to 'out'. Returns the
+ * number of bytes sent (bytes beyond 'max' are sent but not copied).
+ */
+size_t hal_uart_drain(uint8_t *out, size_t max);
+
+// Delivers one received character: runs USART_RX_vect if it is enabled
+void hal_uart_receive(uint8_t data);
+
+// Fires INT0_vect with Timer1 at 'ticks' (32-bit, overflows are replayed)
+void hal_int0_edge(uint32_t ticks);
+
+#endif // HAL_HOST_H
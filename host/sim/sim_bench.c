@@ -0,0 +1,568 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include <gelf.h>
+#include <libelf.h>
+
+#include "sim_avr.h"
+#include "sim_elf.h"
+#include "sim_irq.h"
+#include "sim_interrupts.h"
+#include "sim_cycle_timers.h"
+#include "avr_adc.h"
+#include "avr_ioport.h"
+
+#include "config.h"
+
+/*
+ * Cycle-accurate benchmark of the firmware under simavr
+ *
+ * Loads the firmware ELF into a simulated ATmega328P at F_CPU, drives the
+ * analog inputs with a mains-like waveform and PD2 with the matching
+ * zero-crossing square wave, and measures from the simulator's interrupt
+ * and instruction stream:
+ *   - cycles per ISR (vector entry to RETI) and interrupt latency
+ *     (flag raised to vector entry) for every vector the firmware uses,
+ *     and each vector's share of the CPU (the display's added up)
+ *   - cycles per call of selected main-loop functions (found in the ELF
+ *     symbol table, returns detected from the stack pointer)
+ *   - main-loop slack per mains cycle: the part of each INT0 period not
+ *     spent in ISRs or calculate_sample_metrics()
+ *
+ * The results are checked against a budget file; any miss fails the run.
+ *
+ * Usage: sim_bench <firmware.elf> <budget.txt> [seconds] [line_hz]
+ */
+
+#define SIM_MCU "atmega328p"
+#define SIM_VCC_MV 5000
+
+// Analog inputs are refreshed this often (well below one conversion)
+#define INPUT_UPDATE_CYCLES 40
+
+// Mains cycles ignored at start-up (offset filter, first period measurement)
+#define WARMUP_CYCLES 5
+
+// Front-end model, in mV at the ADC pins
+#define WAVE_OFFSET_MV 2500.0
+#define WAVE_VOLTAGE_MV 1200.0
+#define WAVE_CURRENT_MV 800.0
+#define WAVE_PHASE_RAD 0.5
+
+// SP in data space (I/O 0x3D/0x3E)
+#define SIM_SPL 0x5D
+#define SIM_SPH 0x5E
+
+typedef struct {
+    uint64_t count;
+    uint64_t total;
+    uint64_t min;
+    uint64_t max;
+} cycle_stats_t;
+
+typedef struct {
+    const char *name;
+    uint8_t vector;
+    uint64_t entry_cycle;
+    uint64_t pending_cycle;
+    uint8_t pending;
+    cycle_stats_t duration;
+    cycle_stats_t latency;
+} vector_probe_t;
+
+typedef struct {
+    const char *name;
+    uint32_t address;     // byte address in flash, 0 if not in the ELF
+    uint16_t entry_sp;
+    uint8_t active;
+    uint8_t counts_as_busy;
+    uint64_t entry_cycle;
+    cycle_stats_t duration;
+} function_probe_t;
+
+// ATmega328P vector numbers
+static vector_probe_t vectors[] = {
+    { "INT0_vect",         1,  0, 0, 0, { 0 }, { 0 } },
+    { "TIMER1_OVF_vect",   13, 0, 0, 0, { 0 }, { 0 } },
+    { "TIMER0_COMPA_vect", 14, 0, 0, 0, { 0 }, { 0 } },
+    { "TIMER0_COMPB_vect", 15, 0, 0, 0, { 0 }, { 0 } },
+    { "SPI_STC_vect",      17, 0, 0, 0, { 0 }, { 0 } },
+    { "USART_RX_vect",     18, 0, 0, 0, { 0 }, { 0 } },
+    { "USART_UDRE_vect",   19, 0, 0, 0, { 0 }, { 0 } },
+    { "ADC_vect",          21, 0, 0, 0, { 0 }, { 0 } },
+    { "EE_READY_vect",     22, 0, 0, 0, { 0 }, { 0 } },
+};
+#define VECTOR_COUNT (sizeof(vectors) / sizeof(vectors[0]))
+#define INT0_PROBE 0
+
+static function_probe_t functions[] = {
+    { "calculate_sample_metrics", 0, 0, 0, 1, 0, { 0 } },
+    { "update_scrolling_display", 0, 0, 0, 0, 0, { 0 } },
+    { "usart_send_power_data",    0, 0, 0, 0, 0, { 0 } },
+    { "energy_service",           0, 0, 0, 0, 0, { 0 } },
+    { "numfmt_digits",            0, 0, 0, 0, 0, { 0 } },
+    { "send_next_character_to_display", 0, 0, 0, 0, 0, { 0 } },
+};
+#define FUNCTION_COUNT (sizeof(functions) / sizeof(functions[0]))
+
+// Firmware counters read back from SRAM after the run (static symbols)
+typedef struct {
+    const char *name;
+    uint32_t address;     // data-space address, 0 if not in the ELF
+} variable_probe_t;
+
+static variable_probe_t variables[] = {
+    { "adc_completed_cycles", 0 },
+    { "adc_dropped_cycles",   0 },
+};
+#define VARIABLE_COUNT (sizeof(variables) / sizeof(variables[0]))
+
+static avr_t *avr;
+static elf_firmware_t firmware;
+static double line_hz = LINE_FREQ_NOMINAL_HZ;
+static avr_irq_t *adc_inputs;
+static avr_irq_t *zero_cross_pin;
+static uint8_t zero_cross_level = 0;
+
+// Busy/slack accounting per mains cycle (INT0 to INT0)
+static uint8_t isr_depth = 0;
+static uint8_t busy_functions = 0;
+static uint64_t busy_cycles = 0;
+static uint64_t busy_stamp = 0;
+static uint64_t window_start = 0;
+static uint64_t windows_seen = 0;
+static double slack_min_pct = 100.0;
+static double slack_total_pct = 0.0;
+static uint64_t slack_windows = 0;
+
+static void stats_add(cycle_stats_t *stats, uint64_t value)
+{
+    if (stats->count == 0 || value < stats->min) {
+        stats->min = value;
+    }
+    if (value > stats->max) {
+        stats->max = value;
+    }
+    stats->total += value;
+    stats->count++;
+}
+
+static double stats_avg(const cycle_stats_t *stats)
+{
+    return stats->count ? (double)stats->total / stats->count : 0.0;
+}
+
+// Adds the cycles since the last state change to the busy total
+static void busy_account(void)
+{
+    if (isr_depth > 0 || busy_functions > 0) {
+        busy_cycles += avr->cycle - busy_stamp;
+    }
+    busy_stamp = avr->cycle;
+}
+
+// Closes the mains-cycle window that ends at this INT0 entry
+static void slack_window_close(void)
+{
+    busy_account();
+    if (windows_seen++ >= WARMUP_CYCLES) {
+        uint64_t window = avr->cycle - window_start;
+        double slack = window ? 100.0 * (double)(window - busy_cycles) / window : 0.0;
+        if (slack < slack_min_pct) {
+            slack_min_pct = slack;
+        }
+        slack_total_pct += slack;
+        slack_windows++;
+    }
+    window_start = avr->cycle;
+    busy_cycles = 0;
+}
+
+static void vector_pending_hook(struct avr_irq_t *irq, uint32_t value, void *param)
+{
+    vector_probe_t *probe = param;
+    (void)irq;
+
+    if (value && !probe->pending) {
+        probe->pending = 1;
+        probe->pending_cycle = avr->cycle;
+    } else if (!value) {
+        probe->pending = 0;
+    }
+}
+
+static void vector_running_hook(struct avr_irq_t *irq, uint32_t value, void *param)
+{
+    vector_probe_t *probe = param;
+    (void)irq;
+
+    if (value) {
+        if (probe == &vectors[INT0_PROBE]) {
+            slack_window_close();
+        }
+        busy_account();
+        isr_depth++;
+        probe->entry_cycle = avr->cycle;
+        if (probe->pending) {
+            stats_add(&probe->latency, avr->cycle - probe->pending_cycle);
+            probe->pending = 0;
+        }
+    } else if (isr_depth > 0) {
+        busy_account();
+        isr_depth--;
+        stats_add(&probe->duration, avr->cycle - probe->entry_cycle);
+    }
+}
+
+// Analog front-end: V and I sines locked to the zero-crossing square wave
+static avr_cycle_count_t inputs_update(avr_t *sim, avr_cycle_count_t when, void *param)
+{
+    double t = (double)when / F_CPU;
+    double theta = 2.0 * M_PI * line_hz * t;
+    (void)param;
+
+    avr_raise_irq(adc_inputs + ADC_IRQ_ADC0 + ADC_CH_VMEAS,
+        (uint32_t)(WAVE_OFFSET_MV + WAVE_VOLTAGE_MV * sin(theta)));
+    avr_raise_irq(adc_inputs + ADC_IRQ_ADC0 + ADC_CH_IMEAS,
+        (uint32_t)(WAVE_OFFSET_MV + WAVE_CURRENT_MV * sin(theta - WAVE_PHASE_RAD)));
+    avr_raise_irq(adc_inputs + ADC_IRQ_ADC0 + ADC_CH_OFFSET, (uint32_t)WAVE_OFFSET_MV);
+    (void)sim;
+    return when + INPUT_UPDATE_CYCLES;
+}
+
+// Zero-crossing comparator: rising edge at each upward voltage crossing
+static avr_cycle_count_t zero_cross_toggle(avr_t *sim, avr_cycle_count_t when, void *param)
+{
+    avr_cycle_count_t half_period = (avr_cycle_count_t)(F_CPU / (2.0 * line_hz));
+    (void)sim;
+    (void)param;
+
+    zero_cross_level ^= 1;
+    avr_raise_irq(zero_cross_pin, zero_cross_level);
+    return when + half_period;
+}
+
+// Flash addresses of the probed functions and SRAM addresses of the
+// counters, from the ELF symbol table
+static int resolve_functions(const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0 || elf_version(EV_CURRENT) == EV_NONE) {
+        return -1;
+    }
+    Elf *elf = elf_begin(fd, ELF_C_READ, NULL);
+    Elf_Scn *scn = NULL;
+
+    while (elf && (scn = elf_nextscn(elf, scn)) != NULL) {
+        GElf_Shdr shdr;
+        if (!gelf_getshdr(scn, &shdr) || shdr.sh_type != SHT_SYMTAB || shdr.sh_entsize == 0) {
+            continue;
+        }
+        Elf_Data *data = elf_getdata(scn, NULL);
+        size_t count = shdr.sh_size / shdr.sh_entsize;
+        for (size_t n = 0; data && n < count; n++) {
+            GElf_Sym sym;
+            if (!gelf_getsym(data, (int)n, &sym)) {
+                continue;
+            }
+            const char *name = elf_strptr(elf, shdr.sh_link, sym.st_name);
+            if (!name) {
+                continue;
+            }
+            for (size_t f = 0; GELF_ST_TYPE(sym.st_info) == STT_FUNC && f < FUNCTION_COUNT; f++) {
+                if (strcmp(name, functions[f].name) == 0) {
+                    functions[f].address = (uint32_t)sym.st_value;
+                }
+            }
+            // avr-gcc places SRAM at 0x800000 in the ELF address space
+            for (size_t v = 0; GELF_ST_TYPE(sym.st_info) == STT_OBJECT && v < VARIABLE_COUNT; v++) {
+                if (strcmp(name, variables[v].name) == 0) {
+                    variables[v].address = (uint32_t)sym.st_value & 0xFFFF;
+                }
+            }
+        }
+    }
+    if (elf) {
+        elf_end(elf);
+    }
+    close(fd);
+    return 0;
+}
+
+// Function entry at the first instruction, return once SP rises above the entry SP
+static void functions_step(void)
+{
+    uint16_t sp = avr->data[SIM_SPL] | ((uint16_t)avr->data[SIM_SPH] << 8);
+
+    for (size_t f = 0; f < FUNCTION_COUNT; f++) {
+        function_probe_t *probe = &functions[f];
+        if (probe->address == 0) {
+            continue;
+        }
+        if (!probe->active && avr->pc == probe->address) {
+            probe->active = 1;
+            probe->entry_sp = sp;
+            probe->entry_cycle = avr->cycle;
+            if (probe->counts_as_busy) {
+                busy_account();
+                busy_functions++;
+            }
+        } else if (probe->active && sp > probe->entry_sp) {
+            probe->active = 0;
+            stats_add(&probe->duration, avr->cycle - probe->entry_cycle);
+            if (probe->counts_as_busy) {
+                busy_account();
+                busy_functions--;
+            }
+        }
+    }
+}
+
+// 16-bit firmware counter by name, -1 if the symbol was not found
+static int read_variable(const char *name, double *value)
+{
+    for (size_t v = 0; v < VARIABLE_COUNT; v++) {
+        if (strcmp(name, variables[v].name) == 0 && variables[v].address != 0) {
+            uint32_t address = variables[v].address;
+            *value = (double)(avr->data[address] | ((uint16_t)avr->data[address + 1] << 8));
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Share of all simulated cycles spent in a vector, entry to RETI
+static double vector_load_pct(const vector_probe_t *probe)
+{
+    return avr->cycle ? 100.0 * (double)probe->duration.total / (double)avr->cycle : 0.0;
+}
+
+// Multiplex refresh, brightness blanking and (SPI transport) latch together
+static double display_load_pct(void)
+{
+    double load = 0.0;
+    for (size_t v = 0; v < VECTOR_COUNT; v++) {
+        if (strcmp(vectors[v].name, "TIMER0_COMPA_vect") == 0
+            || strcmp(vectors[v].name, "TIMER0_COMPB_vect") == 0
+            || strcmp(vectors[v].name, "SPI_STC_vect") == 0) {
+            load += vector_load_pct(&vectors[v]);
+        }
+    }
+    return load;
+}
+
+static int lookup_metric(const char *metric, double *value)
+{
+    char name[64];
+    const char *dot = strrchr(metric, '.');
+    if (!dot || (size_t)(dot - metric) >= sizeof(name)) {
+        return -1;
+    }
+    memcpy(name, metric, (size_t)(dot - metric));
+    name[dot - metric] = '\0';
+    const char *field = dot + 1;
+
+    if (strcmp(name, "latency") == 0 && strcmp(field, "max") == 0) {
+        uint64_t worst = 0;
+        for (size_t v = 0; v < VECTOR_COUNT; v++) {
+            if (vectors[v].latency.max > worst) {
+                worst = vectors[v].latency.max;
+            }
+        }
+        *value = (double)worst;
+        return 0;
+    }
+    if (strcmp(name, "slack_pct") == 0 && strcmp(field, "min") == 0) {
+        *value = slack_min_pct;
+        return 0;
+    }
+    if (strcmp(name, "sequences") == 0) {
+        if (strcmp(field, "completed") == 0) {
+            return read_variable("adc_completed_cycles", value);
+        }
+        if (strcmp(field, "dropped") == 0) {
+            return read_variable("adc_dropped_cycles", value);
+        }
+        return -1;
+    }
+    if (strcmp(name, "display") == 0 && strcmp(field, "load_pct") == 0) {
+        *value = display_load_pct();
+        return 0;
+    }
+    for (size_t v = 0; v < VECTOR_COUNT; v++) {
+        if (strcmp(name, vectors[v].name) == 0) {
+            if (strcmp(field, "max") == 0) {
+                *value = (double)vectors[v].duration.max;
+            } else if (strcmp(field, "avg") == 0) {
+                *value = stats_avg(&vectors[v].duration);
+            } else if (strcmp(field, "load_pct") == 0) {
+                *value = vector_load_pct(&vectors[v]);
+            } else if (strcmp(field, "latency_max") == 0) {
+                *value = (double)vectors[v].latency.max;
+            } else {
+                return -1;
+            }
+            return 0;
+        }
+    }
+    for (size_t f = 0; f < FUNCTION_COUNT; f++) {
+        if (strcmp(name, functions[f].name) == 0) {
+            if (strcmp(field, "max") == 0) {
+                *value = (double)functions[f].duration.max;
+            } else if (strcmp(field, "avg") == 0) {
+                *value = stats_avg(&functions[f].duration);
+            } else if (strcmp(field, "spread") == 0) {
+                *value = (double)(functions[f].duration.max - functions[f].duration.min);
+            } else {
+                return -1;
+            }
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Returns the number of failed or unknown budget lines
+static int check_budget(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    char line[160];
+    int failures = 0;
+
+    if (!file) {
+        fprintf(stderr, "cannot open budget file %s\n", path);
+        return 1;
+    }
+    printf("\n%-32s %12s %4s %10s  %s\n", "budget", "measured", "", "limit", "result");
+    while (fgets(line, sizeof(line), file)) {
+        char metric[64];
+        char op[3];
+        double limit;
+        double value;
+
+        if (line[0] == '#' || sscanf(line, "%63s %2s %lf", metric, op, &limit) != 3) {
+            continue;
+        }
+        if (lookup_metric(metric, &value) != 0) {
+            printf("%-32s %12s %4s %10.0f  UNKNOWN\n", metric, "-", op, limit);
+            failures++;
+            continue;
+        }
+        int ok = (strcmp(op, "<=") == 0) ? (value <= limit)
+               : (strcmp(op, ">=") == 0) ? (value >= limit) : 0;
+        printf("%-32s %12.1f %4s %10.0f  %s\n", metric, value, op, limit, ok ? "ok" : "FAIL");
+        failures += !ok;
+    }
+    fclose(file);
+    return failures;
+}
+
+static void print_report(double seconds)
+{
+    printf("MCU %s at %lu Hz, %.1f s simulated, mains %.2f Hz\n\n",
+        SIM_MCU, (unsigned long)F_CPU, seconds, line_hz);
+
+    printf("%-30s %10s %10s %10s %10s %12s %8s\n", "vector", "calls", "min", "avg", "max", "latency max", "load %");
+    for (size_t v = 0; v < VECTOR_COUNT; v++) {
+        const vector_probe_t *probe = &vectors[v];
+        if (probe->duration.count == 0) {
+            continue;
+        }
+        printf("%-30s %10llu %10llu %10.1f %10llu %12llu %8.2f\n", probe->name,
+            (unsigned long long)probe->duration.count, (unsigned long long)probe->duration.min,
+            stats_avg(&probe->duration), (unsigned long long)probe->duration.max,
+            (unsigned long long)probe->latency.max, vector_load_pct(probe));
+    }
+
+    printf("\n%-30s %10s %10s %10s %10s\n", "function", "calls", "min", "avg", "max");
+    for (size_t f = 0; f < FUNCTION_COUNT; f++) {
+        const function_probe_t *probe = &functions[f];
+        if (probe->address == 0) {
+            printf("%-30s (not in ELF)\n", probe->name);
+            continue;
+        }
+        printf("%-30s %10llu %10llu %10.1f %10llu\n", probe->name,
+            (unsigned long long)probe->duration.count, (unsigned long long)probe->duration.min,
+            stats_avg(&probe->duration), (unsigned long long)probe->duration.max);
+    }
+
+    printf("\nDisplay refresh %u Hz per frame, brightness %u/%u: %.2f%% of the CPU\n",
+        (unsigned)DISPLAY_REFRESH_HZ, (unsigned)DISPLAY_BRIGHTNESS, (unsigned)DISPLAY_BRIGHTNESS_MAX,
+        display_load_pct());
+    printf("Mains cycles %llu, slack per cycle min %.1f%% avg %.1f%%\n",
+        (unsigned long long)slack_windows, slack_min_pct,
+        slack_windows ? slack_total_pct / slack_windows : 0.0);
+}
+
+int main(int argc, char **argv)
+{
+    double seconds = 2.0;
+
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s <firmware.elf> <budget.txt> [seconds] [line_hz]\n", argv[0]);
+        return 2;
+    }
+    if (argc > 3) {
+        seconds = atof(argv[3]);
+    }
+    if (argc > 4) {
+        line_hz = atof(argv[4]);
+    }
+    if (seconds <= 0.0 || line_hz < LINE_FREQ_MIN_HZ || line_hz > LINE_FREQ_MAX_HZ) {
+        fprintf(stderr, "seconds must be > 0 and line_hz within %u..%u\n", LINE_FREQ_MIN_HZ, LINE_FREQ_MAX_HZ);
+        return 2;
+    }
+
+    if (elf_read_firmware(argv[1], &firmware) != 0) {
+        fprintf(stderr, "cannot load %s\n", argv[1]);
+        return 2;
+    }
+    resolve_functions(argv[1]);
+
+    avr = avr_make_mcu_by_name(SIM_MCU);
+    if (!avr) {
+        fprintf(stderr, "simavr has no %s core\n", SIM_MCU);
+        return 2;
+    }
+    avr_init(avr);
+    avr->frequency = F_CPU;
+    avr->vcc = avr->avcc = avr->aref = SIM_VCC_MV;
+    avr_load_firmware(avr, &firmware);
+
+    for (size_t v = 0; v < VECTOR_COUNT; v++) {
+        avr_irq_t *irq = avr_get_interrupt_irq(avr, vectors[v].vector);
+        if (irq) {
+            avr_irq_register_notify(irq + AVR_INT_IRQ_PENDING, vector_pending_hook, &vectors[v]);
+            avr_irq_register_notify(irq + AVR_INT_IRQ_RUNNING, vector_running_hook, &vectors[v]);
+        }
+    }
+
+    adc_inputs = avr_io_getirq(avr, AVR_IOCTL_ADC_GETIRQ, 0);
+    zero_cross_pin = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('D'), ZERO_CROSS_PIN);
+    avr_cycle_timer_register(avr, 1, inputs_update, NULL);
+    avr_cycle_timer_register(avr, (avr_cycle_count_t)(F_CPU / (2.0 * line_hz)), zero_cross_toggle, NULL);
+
+    avr_cycle_count_t end_cycle = (avr_cycle_count_t)(seconds * F_CPU);
+    while (avr->cycle < end_cycle) {
+        int state = avr_run(avr);
+        if (state == cpu_Done || state == cpu_Crashed) {
+            fprintf(stderr, "simulation stopped at cycle %llu (state %d)\n",
+                (unsigned long long)avr->cycle, state);
+            return 2;
+        }
+        functions_step();
+    }
+
+    print_report(seconds);
+    int failures = check_budget(argv[2]);
+    if (failures) {
+        printf("\n%d budget line(s) failed\n", failures);
+        return 1;
+    }
+    printf("\nAll budgets met\n");
+    return 0;
+}
@@ -2,9 +2,9 @@
 #include "adc.h"
 #include "config.h"
 #include <avr/interrupt.h>
-#include "powercalc.h"
-#include "uart.h"
 #include "timer.h"
+#include "profile.h"
+#include "eventlog.h"
 
 // INT0 Initialization
 void int0_init(void)
@@ -22,24 +22,68 @@ void int0_init(void)
     EIMSK |= (1 << INT0);
 }
 
-// Global variables (none currently used)
+// Zero-crossing timing against free-running Timer1
+static volatile uint16_t last_edge_ticks = 0;
+static volatile uint16_t line_period_ticks = LINE_PERIOD_NOMINAL_TICKS;
+static volatile uint8_t edges_in_sequence = 0;
 
-// INT0 Interrupt Service Routine - Start new ADC conversion sequence
-ISR(INT0_vect)
+// Edges ignored because the previous sequence was still sampling
+static volatile uint16_t busy_triggers = 0;
+
+// Last valid mains period in Timer1 ticks (nominal until the first measurement)
+uint16_t int0_get_line_period(void)
+{
+    uint8_t sreg = SREG;
+    cli();
+    uint16_t period = line_period_ticks;
+    SREG = sreg;
+    return period;
+}
+
+// Edges that could not start a sequence since reset (a subset of
+// adc_get_dropped_cycles(), which also counts banks the main loop held)
+uint16_t int0_get_busy_triggers(void)
+{
+    uint8_t sreg = SREG;
+    cli();
+    uint16_t count = busy_triggers;
+    SREG = sreg;
+    return count;
+}
+
+// Zero-crossing handling (INT0_vect body)
+static inline void int0_handle_edge(void)
 {
-    // Only start new sequence if previous one is complete AND no ADC conversion is running
-    if (get_ready_for_new_sample() == 1) {
-        usart_transmit_string("INT0 triggered!\r\n");
-        // Reset sampling for new sequence
-        sample_count = 0;
-        current_adc_channel = 0;
-        // Reset the completion flag
-        set_ready_for_new_sample(0);
-        set_adc_sample_complete(0);
-
-        timer1_start();  // Start Timer1 to trigger ADC conversions every 108us
-        adc_enable_auto_trigger();
-        timer1_clear_compare_match_b_flag();
-        adc_start_conversion(ADC_CH_VMEAS); // Start conversion on voltage channel
+    // Timestamp the edge; the low 16 bits wrap every 32.8ms, longer than any accepted period
+    uint32_t edge_ticks = timer1_get_ticks32();
+    uint16_t period = (uint16_t)edge_ticks - last_edge_ticks;
+    last_edge_ticks = (uint16_t)edge_ticks;
+    if (period >= LINE_PERIOD_MIN_TICKS && period <= LINE_PERIOD_MAX_TICKS) {
+        line_period_ticks = period;
     }
+
+    // A sequence per zero-crossing: the ADC fills one bank while the main
+    // loop reduces the other, so only an unfinished sequence blocks a start.
+    // Edges inside a multi-cycle sequence are covered by it.
+    if (adc_is_sequence_running()) {
+        if (++edges_in_sequence >= SAMPLE_CYCLES_PER_SEQUENCE) {
+            busy_triggers++;
+            adc_count_dropped_cycle();
+            LOG_WARN(EV_CYCLE_DROPPED, 0, adc_get_dropped_cycles(), 0);
+        }
+        return;
+    }
+    edges_in_sequence = 0;
+
+    LOG_DEBUG(EV_SEQUENCE_START, 0, line_period_ticks, 0);
+    adc_set_line_period(line_period_ticks);
+    adc_start_sequence(edge_ticks);
+}
+
+// External Interrupt 0 Service Routine - one per mains cycle
+ISR(INT0_vect)
+{
+    PROFILE_ISR_ENTER();
+    int0_handle_edge();
+    PROFILE_ISR_EXIT(PROFILE_ID_INT0);
 }
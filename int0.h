@@ -3,11 +3,17 @@
 
 #include <avr/io.h>
 #include <stdint.h>
+#include "config.h"
+
+// Accepted mains period range in Timer1 ticks (F_CPU, prescaler 1)
+#define LINE_PERIOD_NOMINAL_TICKS ((uint16_t)(F_CPU / LINE_FREQ_NOMINAL_HZ))
+#define LINE_PERIOD_MIN_TICKS ((uint16_t)(F_CPU / LINE_FREQ_MAX_HZ))
+#define LINE_PERIOD_MAX_TICKS ((uint16_t)(F_CPU / LINE_FREQ_MIN_HZ))
 
 // Function declarations
 void int0_init(void);
-
-// External variables (none currently used)
+uint16_t int0_get_line_period(void);
+uint16_t int0_get_busy_triggers(void);
 
 #endif // INT0_H
 
@@ -2,8 +2,8 @@
 
 #include <avr/io.h>
 #include <avr/interrupt.h>
+#include <avr/pgmspace.h>
 #include <stdint.h>
-#include <util/delay.h>
 
 
 #include "uart.h"
@@ -12,42 +12,82 @@
 #include "display.h"
 #include "powercalc.h"
 #include "int0.h"
+#include "energy.h"
+#include "eventlog.h"
+#include "telemetry.h"
+#include "command.h"
+#include "sched.h"
 
 
 
 
-// Global variables for timing (none needed with simple delay approach)
+// Reduces the bank ADC_vect just handed over (event: bank ready). The next
+// sequence is already filling the other bank meanwhile.
+static void task_metrics(void)
+{
+    LOG_DEBUG(EV_BANK_READY, 0, adc_get_ready_bank(), 0);
+    calculate_sample_metrics();
+    display_render_frames();  // Formats the next scroll steps while the results are fresh
+    sched_trigger(SCHED_TASK_TELEMETRY);
+}
+
+// Sends the bank in the binary formats (one frame per sequence), then gives
+// it back to ADC_vect
+static void task_telemetry(void)
+{
+    telemetry_send_sequence(adc_get_ready_bank());
+    set_adc_sample_complete(0);
+}
+
+// Scrolling display and text report, every DISPLAY_UPDATE_MS
+static void task_display(void)
+{
+    powercalc_check_stale();  // No new sequence since the last period: stop showing old values
+    update_scrolling_display();
+    if (telemetry_get_format() == TELEMETRY_FORMAT_TEXT) {
+        usart_send_power_data(); // Send data via UART every 1 second
+    }
+}
+
+static const char task_name_metrics[] PROGMEM = "metrics";
+static const char task_name_telemetry[] PROGMEM = "telemetry";
+static const char task_name_command[] PROGMEM = "command";
+static const char task_name_display[] PROGMEM = "display";
+static const char task_name_eventlog[] PROGMEM = "eventlog";
+static const char task_name_energy[] PROGMEM = "energy";
 
 int main(void)
 {
     // Initialize hardware peripherals
-    usart_init(UART_BAUD_PRESCALER);
+    usart_init();
     adc_init();
     init_display();  // Initialize display FIRST to configure PORTD pins properly
-    timer0_init();  // Timer0 handles display multiplexing
+    timer0_init();  // Timer0 handles display multiplexing and the millisecond timebase
     timer1_init();  // Timer1 handles ADC sampling
     int0_init();    // INT0 triggers new ADC sequences (must be after init_display)
     init_scrolling_display();
     powercalc_init();
+    eventlog_init();
+    telemetry_init();
+    energy_init();  // Restore the energy total from the newest EEPROM checkpoint
+
+    // Tasks in priority order (sched.h)
+    sched_init();
+    sched_add(SCHED_TASK_METRICS, task_name_metrics, task_metrics, 0);
+    sched_add(SCHED_TASK_TELEMETRY, task_name_telemetry, task_telemetry, 0);
+    sched_add(SCHED_TASK_COMMAND, task_name_command, command_service, 0);
+    sched_add(SCHED_TASK_DISPLAY, task_name_display, task_display, DISPLAY_UPDATE_MS);
+    sched_add(SCHED_TASK_EVENTLOG, task_name_eventlog, eventlog_service, SCHED_EVENTLOG_MS);
+    sched_add(SCHED_TASK_ENERGY, task_name_energy, energy_service, SCHED_ENERGY_MS);
 
     // Enable global interrupts
     sei();
 
-    // Main application loop
+    // Main application loop: run ready tasks, sleep when there are none
     while (1)
-    {		
-      
-      // Check if 24 samples are complete and ADC is idle
-      if ( get_adc_sample_complete() == 1) {
-        usart_transmit_string("ADC sample complete!\r\n");
-        calculate_sample_metrics();
-        set_adc_sample_complete(0);
+    {
+      if (!sched_dispatch()) {
+        sched_idle();
       }
-          
-      // Update scrolling display every 1 second using simple delay
-      // Display keeps showing last calculated values during new sampling
-      update_scrolling_display();
-      usart_send_power_data(); // Send data via UART every 1 second
-      _delay_ms(DISPLAY_UPDATE_MS); // Wait exactly 1 second
     }       
 }
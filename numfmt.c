@@ -0,0 +1,89 @@
+#include "numfmt.h"
+
+/*
+ * Splits 'value' into NUMFMT_MAX_DIGITS decimal digits, most significant
+ * first, one digit (0-9) per byte; returns the number of significant digits
+ * (at least 1, so zero is one digit)
+ *
+ * Double dabble: the value is shifted bit by bit into a packed BCD register,
+ * and before each shift every BCD digit of 5 or more gets 3 added so that
+ * doubling it carries into the next digit. Only shifts, compares and adds,
+ * no division. Leading zero bytes of the value are skipped, so a 16-bit
+ * value costs half the iterations.
+ */
+uint8_t numfmt_digits(uint32_t value, uint8_t *digits)
+{
+    uint8_t bcd[NUMFMT_MAX_DIGITS / 2] = {0};  // Packed, least significant byte first
+    uint8_t active = 1;                        // BCD bytes that can be non-zero yet
+    uint8_t bits = 32;
+
+    while (bits > 8 && (value >> 24) == 0) {
+        value <<= 8;
+        bits -= 8;
+    }
+
+    while (bits-- > 0) {
+        uint8_t carry = (uint8_t)(value >> 31);
+        value <<= 1;
+
+        for (uint8_t i = 0; i < active; i++) {
+            uint8_t pair = bcd[i];
+            if ((pair & 0x0F) >= 0x05) {
+                pair += 0x03;
+            }
+            if (pair >= 0x50) {
+                pair += 0x30;
+            }
+            bcd[i] = (uint8_t)((pair << 1) | carry);
+            carry = pair >> 7;
+        }
+        if (carry) {
+            bcd[active++] = 1;
+        }
+    }
+
+    for (uint8_t i = 0; i < NUMFMT_MAX_DIGITS / 2; i++) {
+        digits[NUMFMT_MAX_DIGITS - 1 - 2 * i] = bcd[i] & 0x0F;
+        digits[NUMFMT_MAX_DIGITS - 2 - 2 * i] = bcd[i] >> 4;
+    }
+
+    uint8_t significant = NUMFMT_MAX_DIGITS;
+    while (significant > 1 && digits[NUMFMT_MAX_DIGITS - significant] == 0) {
+        significant--;
+    }
+    return significant;
+}
+
+/*
+ * Writes fixed-point 'value' as text with 'decimals' digits after the
+ * decimal point (value 1234, 1 decimal -> "123.4") and a leading '-' if
+ * 'negative' is set and the value is not zero
+ *
+ * Leading zeros are blanked down to the units digit (5 with 3 decimals is
+ * "0.005"). 'buffer' needs NUMFMT_BUFFER_SIZE bytes; the text is
+ * terminated and its length returned. At most 9 decimals.
+ */
+uint8_t numfmt_fixed(char *buffer, uint32_t value, uint8_t decimals, uint8_t negative)
+{
+    uint8_t digits[NUMFMT_MAX_DIGITS];
+    uint8_t significant = numfmt_digits(value, digits);
+    uint8_t length = 0;
+
+    if (decimals > NUMFMT_MAX_DIGITS - 1) {
+        decimals = NUMFMT_MAX_DIGITS - 1;
+    }
+    if (significant <= decimals) {
+        significant = decimals + 1;
+    }
+    if (negative && value != 0) {
+        buffer[length++] = '-';
+    }
+    for (uint8_t i = NUMFMT_MAX_DIGITS - significant; i < NUMFMT_MAX_DIGITS; i++) {
+        if (i == NUMFMT_MAX_DIGITS - decimals) {
+            buffer[length++] = '.';
+        }
+        buffer[length++] = (char)('0' + digits[i]);
+    }
+    buffer[length] = '\0';
+    return length;
+}
@@ -0,0 +1,16 @@
+#ifndef NUMFMT_H
+#define NUMFMT_H
+
+#include <stdint.h>
+
+// Decimal digits of the largest uint32_t (4294967295)
+#define NUMFMT_MAX_DIGITS 10
+
+// Longest numfmt_fixed() output: sign, 10 digits, decimal point, terminator
+#define NUMFMT_BUFFER_SIZE (NUMFMT_MAX_DIGITS + 3)
+
+// Function declarations
+uint8_t numfmt_digits(uint32_t value, uint8_t *digits);
+uint8_t numfmt_fixed(char *buffer, uint32_t value, uint8_t decimals, uint8_t negative);
+
+#endif // NUMFMT_H
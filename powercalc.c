@@ -1,21 +1,45 @@
 #include "powercalc.h"
 #include "config.h"
 #include "adc.h"
-#include "uart.h"
+#include "int0.h"
+#include "energy.h"
+#include "timer.h"
+#include "fixmath.h"
+#include "eventlog.h"
 #include <avr/interrupt.h>
-#include <math.h>
 
 // Global variables for power calculations
 
-// New variables for 24-sample calculations
-volatile uint16_t average_power_raw = 0.0f;
-volatile uint16_t rms_voltage_raw = 0.0f;
-volatile uint16_t peak_current_raw = 0.0f;
+// Fixed-point results of the last sequence
+static uint32_t average_power_mW = 0;
+static uint32_t rms_voltage_mV = 0;
+static uint16_t peak_current_dmA = 0;
+static uint16_t rms_current_dmA = 0;
+
+// Stamp of the last result: sequence number (+1 per calculate_sample_metrics()
+// call, never reset after powercalc_init()) and Timer1 ticks of its INT0 edge
+static uint32_t result_sequence = 0;
+static uint32_t result_ticks = 0;
+
+// Report periods that found no new result (powercalc_check_stale())
+static uint32_t checked_sequence = 0;
+static uint16_t stale_reports = 0;
+
+// The scaled products must fit in 32 bits for a full-scale (±512 count) signal
+_Static_assert(POWER_SCALE_Q <= UINT32_MAX / (512UL * 512UL), "POWER_SCALE_Q overflows 32-bit product");
+_Static_assert(VOLTAGE_SCALE_Q <= UINT32_MAX / (512UL << RMS_FRAC_BITS), "VOLTAGE_SCALE_Q overflows 32-bit product");
+_Static_assert(CURRENT_RMS_SCALE_Q <= UINT32_MAX / (512UL << RMS_FRAC_BITS), "CURRENT_RMS_SCALE_Q overflows 32-bit product");
+_Static_assert(CURRENT_SCALE_Q <= UINT32_MAX / 512UL, "CURRENT_SCALE_Q overflows 32-bit product");
+
+// Run-time calibration trims, Q(CAL_TRIM_FRAC_BITS); results stay within
+// 32 bits (power ~115 W at full scale) and 16 bits (currents) below 2.0
+static uint16_t voltage_trim_q = CAL_TRIM_ONE;
+static uint16_t current_trim_q = CAL_TRIM_ONE;
 
 // Display buffer for thread-safe display updates
-volatile uint16_t display_power = 0.0f;
-volatile uint16_t display_voltage = 0.0f;
-volatile uint16_t display_current = 0.0f;
+volatile uint16_t display_power = 0;    // 0.1 W
+volatile uint16_t display_voltage = 0;  // 0.1 V
+volatile uint16_t display_current = 0;  // 1 mA (4 digits: 0.1 mA would end at 999.9)
 
 // Buffers for power calculations
 static uint16_t power_buffer[POWER_BUFFER_SIZE];
@@ -23,14 +47,17 @@ static uint8_t power_buffer_index = 0;
 static uint8_t power_buffer_full = 0;
 
 volatile uint8_t display_data_ready = 0;
-volatile uint8_t ready_for_new_sample = 1;
+
+// Start of the previous measured sequence, for the energy integration interval
+static uint32_t last_sequence_ticks = 0;
+static uint8_t last_sequence_valid = 0;
 
 // Power calculation initialization
 void powercalc_init(void)
 {
     // Initialize power buffer
     for (uint8_t i = 0; i < POWER_BUFFER_SIZE; i++) {
-        power_buffer[i] = 0.0f;
+        power_buffer[i] = 0;
     }
     
     // Initialize variables
@@ -38,115 +65,270 @@ void powercalc_init(void)
     power_buffer_full = 0;
     
     // Initialize display buffer (ensure zeros are displayed initially)
-    display_power = 0.0f;
-    display_voltage = 0.0f;
-    display_current = 0.0f;
+    display_power = 0;
+    display_voltage = 0;
+    display_current = 0;
+    average_power_mW = 0;
+    rms_voltage_mV = 0;
+    peak_current_dmA = 0;
+    rms_current_dmA = 0;
+    voltage_trim_q = CAL_TRIM_ONE;
+    current_trim_q = CAL_TRIM_ONE;
 	display_data_ready = 0;
-	ready_for_new_sample = 1;
+	last_sequence_valid = 0;
+	result_sequence = 0;
+	result_ticks = 0;
+	checked_sequence = 0;
+	stale_reports = 0;
 }
 
-/**
- * @brief Approximates the current sample (I_L_bar) at the time of a voltage sample.
- * This function assumes 'i' is always > 0.
+/*
+ * Integrates the power of the sequence in 'bank' into the energy total
+ *
+ * The interval runs from the start of the previous measured sequence to the
+ * start of this one, so cycles dropped in between are still counted at the
+ * current power. After a gap longer than ENERGY_MAX_GAP_MS (no mains) only
+ * this sequence's own span is counted.
  */
-uint16_t approximate_current_at_V(volatile uint16_t i_samples[], uint8_t i)
+static void integrate_energy(uint8_t bank, uint32_t power_mW)
 {
-    // Implements the formula: I_L_bar[i] = (I_L[i-1] + I_L[i]) / 2
-    return (i_samples[i - 1] + i_samples[i]) / 2;
-}
+	uint32_t start_ticks = adc_get_bank_start_ticks(bank);
+	uint32_t elapsed_ticks = start_ticks - last_sequence_ticks;
 
-/**
- * @brief Approximates the voltage sample (V_AC_bar) at the time of a current sample.
- * This function assumes 'i' is always < (size - 1).
- */
-uint16_t approximate_voltage_at_I(volatile uint16_t v_samples[], uint8_t i)
-{
-    // Implements the formula: V_AC_bar[i] = (V_AC[i] + V_AC[i+1]) / 2
-    return (v_samples[i] + v_samples[i + 1]) / 2;
+	if (!last_sequence_valid || elapsed_ticks > (uint32_t)ENERGY_MAX_GAP_MS * (TIMER1_TICKS_PER_SECOND / 1000)) {
+		elapsed_ticks = (uint32_t)int0_get_line_period() * SAMPLE_CYCLES_PER_SEQUENCE;
+	}
+	last_sequence_ticks = start_ticks;
+	last_sequence_valid = 1;
+
+	energy_accumulate(power_mW, elapsed_ticks);
 }
 
+// Offset-corrected sums of one sequence, in ADC counts
+typedef struct {
+	int32_t power_sum_x2;      // Σ 2·(v·i_bar + v_bar·i) over the inner samples
+	uint32_t voltage_sq_sum;   // Σ v² over all samples
+	uint32_t current_sq_sum;   // Σ i² over all samples
+	int16_t peak_current;      // max i over all samples
+} sequence_sums_t;
 
+#if ADC_ACCUMULATION_MODE == ADC_ACCUM_STREAMING
+/*
+ * Removes the offset from the raw sums ADC_vect built for 'bank'
+ *
+ * Every term is a product (a - o)(b - o) = a·b - o·(a + b) + o², so the
+ * offset can be applied once per sequence instead of once per sample:
+ *   Σ w(a-o)(b-o) = Σ w·a·b - o·Σ w(a+b) + o²·Σ w
+ * The arithmetic wraps in uint32_t; the final results fit in int32_t.
+ */
+static void reduce_stream_sums(uint8_t bank, uint8_t samples, uint16_t offset, sequence_sums_t *sums)
+{
+	volatile adc_stream_sums_t *raw = &adc_stream_sums[bank];
+	uint32_t offset_sq = (uint32_t)offset * offset;
 
-// Calculate power metrics from 24 samples
-void calculate_sample_metrics(void)
+	sums->power_sum_x2 = (int32_t)(raw->sum_vi
+		- offset * raw->sum_vi_lin
+		+ offset_sq * ADC_STREAM_VI_WEIGHT(samples));
+	sums->voltage_sq_sum = raw->sum_v_sq
+		- 2UL * offset * raw->sum_v
+		+ offset_sq * samples;
+	sums->current_sq_sum = raw->sum_i_sq
+		- 2UL * offset * raw->sum_i
+		+ offset_sq * samples;
+	sums->peak_current = (int16_t)raw->max_i - (int16_t)offset;
+}
+#else
+// Walks the sample arrays of 'bank' and builds the offset-corrected sums
+static void reduce_sample_arrays(uint8_t bank, uint8_t samples, uint16_t offset, sequence_sums_t *sums)
 {
-	// --- MAIN CALCULATION STEP ---
-	uint16_t power_sum_raw = 0;
-	uint32_t sum_voltage_squared_raw = 0;
-	uint16_t max_current_signed_raw = 0;
+	volatile uint16_t *voltage_samples = voltage_samples_raw[bank];
+	volatile uint16_t *current_samples = current_samples_raw[bank];
 
-	// DEBUG: Print offset_sample value
-	usart_transmit_string("Offset: ");
-	usart_transmit_float(offset_sample, 0);
-	usart_transmit_string("\r\n");
+	sums->power_sum_x2 = 0;
+	sums->voltage_sq_sum = 0;
+	sums->current_sq_sum = 0;
+	sums->peak_current = INT16_MIN;
 
-	for( uint8_t i = 0; i < (uint8_t)SAMPLE_BUFFER_SIZE; i++ ){
-		// DEBUG: Print raw values for first few samples
+	for( uint8_t i = 0; i < samples; i++ ){
 		if (i < 3) {
-			usart_transmit_string("Sample[");
-			usart_transmit_float(i, 0);
-			usart_transmit_string("]: V_raw=");
-			usart_transmit_float(voltage_samples_raw[i], 0);
-			usart_transmit_string(" I_raw=");
-			usart_transmit_float(current_samples_raw[i], 0);
-			usart_transmit_string("\r\n");
+			LOG_DEBUG(EV_SAMPLE_RAW, i, voltage_samples[i], current_samples[i]);
 		}
+
+		int16_t v_sample = (int16_t)voltage_samples[i] - (int16_t)offset;
+		int16_t i_sample = (int16_t)current_samples[i] - (int16_t)offset;
 		
-		uint16_t v_sample = voltage_samples_raw[i] - offset_sample;
-		uint16_t i_sample = current_samples_raw[i] - offset_sample;
-		
-		// DEBUG: Print calculated values for first few samples
 		if (i < 3) {
-			usart_transmit_string("  After subtract: v_sample=");
-			usart_transmit_float(v_sample, 0);
-			usart_transmit_string(" i_sample=");
-			usart_transmit_float(i_sample, 0);
-			usart_transmit_string("\r\n");
+			LOG_DEBUG(EV_SAMPLE_CENTRED, i, (uint16_t)v_sample, (uint16_t)i_sample);
 		}
 		// 1. Average Power using Linear Approximation (only on inner samples)
-		if (i > 0 && i < (uint8_t)SAMPLE_BUFFER_SIZE - 1) {
-			// Call helper functions to get the approximated values
-			uint16_t v_bar = approximate_voltage_at_I(voltage_samples_raw, i);
-			uint16_t i_bar = approximate_current_at_V(current_samples_raw, i);
-					
+		if (i > 0 && i < samples - 1) {
+			// Linear interpolation, kept doubled so nothing is truncated:
+			// 2·I_L_bar[i] = I_L[i-1] + I_L[i], 2·V_AC_bar[i] = V_AC[i] + V_AC[i+1]
+			int16_t i_bar_x2 = (int16_t)(current_samples[i - 1] + current_samples[i]) - 2 * (int16_t)offset;
+			int16_t v_bar_x2 = (int16_t)(voltage_samples[i] + voltage_samples[i + 1]) - 2 * (int16_t)offset;
+
 			// Sum the two power estimates
-			power_sum_raw += (v_sample * i_bar) + (v_bar * i_sample);
+			sums->power_sum_x2 += (int32_t)v_sample * i_bar_x2 + (int32_t)v_bar_x2 * i_sample;
 
 		}
 
-		// 2. RMS Voltage (using all samples)
-		sum_voltage_squared_raw += v_sample * v_sample;
+		// 2. RMS Voltage and Current (using all samples)
+		sums->voltage_sq_sum += (int32_t)v_sample * v_sample;
+		sums->current_sq_sum += (int32_t)i_sample * i_sample;
 				
 		// 3. Peak Current (using all  samples)
-		if (i_sample > max_current_signed_raw) {
-			max_current_signed_raw = i_sample;
+		if (i_sample > sums->peak_current) {
+			sums->peak_current = i_sample;
 		}
 	}
-	usart_transmit_string(" ----->");
-	usart_transmit_float(max_current_signed_raw ,0);
-	usart_transmit_string(" \r\n");
-
-	
-	uint8_t power_sample_count = SAMPLE_BUFFER_SIZE - 2;
-	average_power_raw = power_sum_raw / (2.0 * (uint16_t)power_sample_count);
-	rms_voltage_raw = sqrt(sum_voltage_squared_raw / (uint16_t)SAMPLE_BUFFER_SIZE);
-	peak_current_raw = max_current_signed_raw;
-	
-
-
-	//Covert ADC value to actual values and Atomic copy to display buffer
-	uint16_t average_power_sample_W = average_power_raw * (uint16_t)(ADC_VREF / ADC_MAX_VALUE)/1000; // in W
-	uint16_t rms_voltage_sample_mV = rms_voltage_raw * (uint16_t)(ADC_VREF / ADC_MAX_VALUE)/1000; // in V
-	uint16_t peak_current_sample_mA = peak_current_raw *(uint16_t)(ADC_VREF / ADC_MAX_VALUE)/1000; // in mA
-	
-	
+}
+#endif
+
+// Multiplies a scaled result by a calibration trim (rounded)
+static inline uint32_t apply_trim(uint32_t value, uint16_t trim_q)
+{
+	return (value * trim_q + (1UL << (CAL_TRIM_FRAC_BITS - 1))) >> CAL_TRIM_FRAC_BITS;
+}
+
+// Calculate power metrics from 24 samples
+// Reads the bank published by ADC_vect; the caller releases it afterwards
+void calculate_sample_metrics(void)
+{
+	// --- MAIN CALCULATION STEP ---
+	sequence_sums_t sums;
+
+	uint8_t bank = adc_get_ready_bank();
+	uint8_t samples = adc_get_bank_samples(bank);
+	uint16_t offset = adc_get_offset();
+
+	LOG_DEBUG(EV_OFFSET, 0, offset, 0);
+
+#if ADC_ACCUMULATION_MODE == ADC_ACCUM_STREAMING
+	reduce_stream_sums(bank, samples, offset, &sums);
+#else
+	reduce_sample_arrays(bank, samples, offset, &sums);
+#endif
+
+	LOG_DEBUG(EV_PEAK_CURRENT, 0, (uint16_t)sums.peak_current, 0);
+
+	// --- SCALING STEP (integer only) ---
+	// Mean power in counts², RMS values in 1/2^RMS_FRAC_BITS counts, peak current in counts.
+	// Negative readings (power export, current below offset) display as zero
+	int32_t power_sample_count_x4 = 4 * (int32_t)(samples - 2);
+	int32_t average_power_signed = sums.power_sum_x2 / power_sample_count_x4;
+	uint32_t average_power_counts = (average_power_signed > 0) ? (uint32_t)average_power_signed : 0;
+	uint16_t rms_voltage_counts = isqrt32_frac(sums.voltage_sq_sum / samples, RMS_FRAC_BITS);
+	uint16_t rms_current_counts = isqrt32_frac(sums.current_sq_sum / samples, RMS_FRAC_BITS);
+	uint16_t peak_current_counts = (sums.peak_current > 0) ? (uint16_t)sums.peak_current : 0;
+
+	// Counts to physical units with the compile-time Q multipliers (rounded)
+	average_power_mW = (average_power_counts * POWER_SCALE_Q
+		+ (1UL << (POWER_SCALE_FRAC_BITS - 1))) >> POWER_SCALE_FRAC_BITS;
+	rms_voltage_mV = ((uint32_t)rms_voltage_counts * VOLTAGE_SCALE_Q
+		+ (1UL << (VOLTAGE_SCALE_FRAC_BITS + RMS_FRAC_BITS - 1))) >> (VOLTAGE_SCALE_FRAC_BITS + RMS_FRAC_BITS);
+	rms_current_dmA = (uint16_t)(((uint32_t)rms_current_counts * CURRENT_RMS_SCALE_Q
+		+ (1UL << (CURRENT_RMS_SCALE_FRAC_BITS + RMS_FRAC_BITS - 1))) >> (CURRENT_RMS_SCALE_FRAC_BITS + RMS_FRAC_BITS));
+	peak_current_dmA = (uint16_t)(((uint32_t)peak_current_counts * CURRENT_SCALE_Q
+		+ (1UL << (CURRENT_SCALE_FRAC_BITS - 1))) >> CURRENT_SCALE_FRAC_BITS);
+
+	// Run-time calibration
+	average_power_mW = apply_trim(apply_trim(average_power_mW, voltage_trim_q), current_trim_q);
+	rms_voltage_mV = apply_trim(rms_voltage_mV, voltage_trim_q);
+	rms_current_dmA = (uint16_t)apply_trim(rms_current_dmA, current_trim_q);
+	peak_current_dmA = (uint16_t)apply_trim(peak_current_dmA, current_trim_q);
+
+	result_sequence++;
+	result_ticks = adc_get_bank_start_ticks(bank);
+
+	// Atomic copy to display buffer
 	cli();
-	display_power = average_power_sample_W * (uint16_t)VOLTAGE_DIVIDER_RATIO * (uint16_t)CURRENT_OPAM_GAIN * (uint16_t)(CURRENT_SHUNT_RESISTOR*1000)/1000;
-	display_voltage = rms_voltage_sample_mV* (uint16_t)VOLTAGE_DIVIDER_RATIO;
-	display_current = peak_current_sample_mA / ((uint16_t)CURRENT_OPAM_GAIN * (uint16_t)(CURRENT_SHUNT_RESISTOR*1000)/1000);
+	display_power = (uint16_t)((average_power_mW + 50) / 100);
+	display_voltage = (uint16_t)((rms_voltage_mV + 50) / 100);
+	display_current = (uint16_t)((peak_current_dmA + 5) / 10);
 	set_display_data_ready(1);
-	set_ready_for_new_sample(1);
 	sei();
+
+	integrate_energy(bank, average_power_mW);
+}
+
+/*
+ * Sets the voltage and current gain trims (Q(CAL_TRIM_FRAC_BITS), 1.0 =
+ * CAL_TRIM_ONE) from the next sequence on. Returns 0 and keeps the old
+ * trims unless both are between 0.5 and 2.0.
+ */
+uint8_t powercalc_set_calibration(uint16_t voltage_trim, uint16_t current_trim)
+{
+    if (voltage_trim < CAL_TRIM_ONE / 2 || voltage_trim >= 2 * CAL_TRIM_ONE
+        || current_trim < CAL_TRIM_ONE / 2 || current_trim >= 2 * CAL_TRIM_ONE) {
+        return 0;
+    }
+    voltage_trim_q = voltage_trim;
+    current_trim_q = current_trim;
+    return 1;
+}
+
+// Number of the last result (0 until the first sequence is measured)
+uint32_t powercalc_get_sequence(void)
+{
+    return result_sequence;
+}
+
+// Timer1 timestamp of the INT0 edge that started the last result's sequence
+uint32_t powercalc_get_timestamp(void)
+{
+    return result_ticks;
+}
+
+/*
+ * Report-period check (main loop, once per DISPLAY_UPDATE_MS): if no
+ * sequence was measured since the previous check, counts a stale report
+ * and withdraws the display data, so values are not repeated as if they
+ * were live once INT0 stops
+ */
+void powercalc_check_stale(void)
+{
+    if (result_sequence == checked_sequence) {
+        stale_reports++;
+        set_display_data_ready(0);
+    }
+    checked_sequence = result_sequence;
+}
+
+// Report periods without a new result since powercalc_init()
+uint16_t powercalc_get_stale_reports(void)
+{
+    return stale_reports;
+}
+
+uint16_t powercalc_get_voltage_trim(void)
+{
+    return voltage_trim_q;
+}
+
+uint16_t powercalc_get_current_trim(void)
+{
+    return current_trim_q;
+}
+
+// Fixed-point results of the last sequence (main-loop context)
+uint32_t get_average_power_mW(void)
+{
+    return average_power_mW;
+}
+
+uint32_t get_rms_voltage_mV(void)
+{
+    return rms_voltage_mV;
+}
+
+uint16_t get_peak_current_dmA(void)
+{
+    return peak_current_dmA;
+}
+
+uint16_t get_rms_current_dmA(void)
+{
+    return rms_current_dmA;
 }
 
 
@@ -183,11 +365,3 @@ void set_adc_sample_complete(uint8_t complete)
 {
     adc_sample_complete = complete;
 }
-uint8_t get_ready_for_new_sample(void)
-{
-    return ready_for_new_sample;
-}
-void set_ready_for_new_sample(uint8_t ready)
-{
-    ready_for_new_sample = ready;
-}
\ No newline at end of file
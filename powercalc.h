@@ -3,15 +3,60 @@
 
 #include <avr/io.h>
 #include <stdint.h>
+#include "config.h"
+#include "fixmath.h"
 
 // Power calculation configuration
 #define POWER_BUFFER_SIZE 100   // Buffer for power calculations
 
+// ----------------------------------------------------------------------------
+// Fixed-point scaling from ADC counts to physical units
+// ----------------------------------------------------------------------------
+// All multipliers are built from config.h at compile time; the measurement
+// path itself is integer only (no float runtime, no libm).
+
+// Millivolts at the ADC pin per count
+#define ADC_MV_PER_COUNT ((double)ADC_VREF / ADC_MAX_VALUE)
+
+// RMS values are taken with isqrt32_frac() to this many fractional bits
+// (1/16 count resolution); the scale factors below absorb them
+#define RMS_FRAC_BITS 4
+
+// RMS voltage: mains mV per RMS count
+#define VOLTAGE_SCALE_FRAC_BITS 12
+#define VOLTAGE_SCALE_Q FIXMATH_Q(ADC_MV_PER_COUNT * VOLTAGE_DIVIDER_RATIO, VOLTAGE_SCALE_FRAC_BITS)
+
+// Peak current: 0.1 mA per count through the shunt and current amplifier
+#define CURRENT_SCALE_FRAC_BITS 16
+#define CURRENT_SCALE_Q FIXMATH_Q(ADC_MV_PER_COUNT * 10.0 / (CURRENT_OPAM_GAIN * CURRENT_SHUNT_RESISTOR), CURRENT_SCALE_FRAC_BITS)
+
+// RMS current: 0.1 mA per RMS count (fewer fractional bits, the input carries RMS_FRAC_BITS)
+#define CURRENT_RMS_SCALE_FRAC_BITS 12
+#define CURRENT_RMS_SCALE_Q FIXMATH_Q(ADC_MV_PER_COUNT * 10.0 / (CURRENT_OPAM_GAIN * CURRENT_SHUNT_RESISTOR), CURRENT_RMS_SCALE_FRAC_BITS)
+
+// Average power: mW per count² (mV x mA / 1000)
+#define POWER_SCALE_FRAC_BITS 12
+#define POWER_SCALE_Q FIXMATH_Q(ADC_MV_PER_COUNT * ADC_MV_PER_COUNT * VOLTAGE_DIVIDER_RATIO \
+                                / (CURRENT_OPAM_GAIN * CURRENT_SHUNT_RESISTOR) / 1000.0, POWER_SCALE_FRAC_BITS)
+
+// Run-time calibration trims on top of the constants above: gain factors in
+// Q(CAL_TRIM_FRAC_BITS) applied to the scaled results, below 2.0. The power
+// result takes both trims.
+#define CAL_TRIM_FRAC_BITS 14
+#define CAL_TRIM_ONE (1U << CAL_TRIM_FRAC_BITS)
+
 // Function declarations
-uint16_t approximate_current_at_V(volatile uint16_t i_samples[], uint8_t i);
-uint16_t approximate_voltage_at_I(volatile uint16_t v_samples[], uint8_t i);
 void powercalc_init(void);
 void powercalc_update_samples(uint16_t vmeas_adc, uint16_t imeas_adc, uint16_t offset_adc);
+uint8_t powercalc_set_calibration(uint16_t voltage_trim_q, uint16_t current_trim_q);
+uint16_t powercalc_get_voltage_trim(void);
+uint16_t powercalc_get_current_trim(void);
+
+// Result stamps and report staleness
+uint32_t powercalc_get_sequence(void);
+uint32_t powercalc_get_timestamp(void);
+void powercalc_check_stale(void);
+uint16_t powercalc_get_stale_reports(void);
 
 // New 24-sample calculation functions
 void calculate_sample_metrics(void);
@@ -19,7 +64,13 @@ uint16_t get_average_power_24(void);
 uint16_t get_rms_voltage_24(void);
 uint16_t get_peak_current_24(void);
 
-// Thread-safe display buffer functions
+// Fixed-point results of the last sequence
+uint32_t get_average_power_mW(void);
+uint32_t get_rms_voltage_mV(void);
+uint16_t get_peak_current_dmA(void);
+uint16_t get_rms_current_dmA(void);
+
+// Thread-safe display buffer functions (0.1 W, 0.1 V, 1 mA)
 uint16_t get_display_power(void);
 uint16_t get_display_voltage(void);
 uint16_t get_display_current(void);
@@ -27,8 +78,6 @@ uint8_t is_display_data_ready(void);
 void set_display_data_ready(uint8_t ready);
 uint8_t get_adc_sample_complete(void);
 void set_adc_sample_complete(uint8_t complete);
-uint8_t get_ready_for_new_sample(void);
-void set_ready_for_new_sample(uint8_t ready);
 
 
 #endif // POWERCALC_H
@@ -0,0 +1,138 @@
+#include "profile.h"
+#include "uart.h"
+#include "timer.h"
+#include <avr/interrupt.h>
+
+#if PROFILE_ISR
+
+// Per-vector statistics in Timer1 ticks (CPU cycles)
+typedef struct {
+    uint16_t min;
+    uint16_t max;
+    uint32_t total;
+    uint32_t count;
+    uint16_t latency_max;
+} profile_stats_t;
+
+static volatile profile_stats_t profile_stats[PROFILE_ID_COUNT];
+
+// Timer1 timestamp of the start of the statistics window (for the load)
+static uint32_t profile_window_start = 0;
+
+static const char profile_name_adc[] PROGMEM = "ADC_vect";
+static const char profile_name_int0[] PROGMEM = "INT0_vect";
+static const char profile_name_timer0[] PROGMEM = "TIMER0_COMPA_vect";
+static const char profile_name_spi[] PROGMEM = "SPI_STC_vect";
+
+static const char *const profile_names[PROFILE_ID_COUNT] PROGMEM = {
+    profile_name_adc,
+    profile_name_int0,
+    profile_name_timer0,
+    profile_name_spi,
+};
+
+// Bit per vector whose latency is measured (INT0 edges carry no timestamp)
+#define PROFILE_LATENCY_MASK ((1 << PROFILE_ID_ADC) | (1 << PROFILE_ID_TIMER0))
+
+// Called from the ISR being profiled (interrupts disabled)
+void profile_record_duration(uint8_t id, uint16_t ticks)
+{
+    volatile profile_stats_t *stats = &profile_stats[id];
+
+    if (stats->count == 0 || ticks < stats->min) {
+        stats->min = ticks;
+    }
+    if (ticks > stats->max) {
+        stats->max = ticks;
+    }
+    stats->total += ticks;
+    stats->count++;
+}
+
+// Called from the ISR being profiled; early entries (negative) count as zero
+void profile_record_latency(uint8_t id, int16_t ticks)
+{
+    uint16_t latency = (ticks > 0) ? (uint16_t)ticks : 0;
+
+    if (latency > profile_stats[id].latency_max) {
+        profile_stats[id].latency_max = latency;
+    }
+}
+
+void profile_reset(void)
+{
+    uint8_t sreg = SREG;
+    cli();
+    for (uint8_t id = 0; id < PROFILE_ID_COUNT; id++) {
+        profile_stats[id].min = 0;
+        profile_stats[id].max = 0;
+        profile_stats[id].total = 0;
+        profile_stats[id].count = 0;
+        profile_stats[id].latency_max = 0;
+    }
+    profile_window_start = timer1_get_ticks32();
+    SREG = sreg;
+}
+
+/*
+ * Sends the statistics collected since the last dump, then starts a new
+ * window (keeps the 32-bit totals from overflowing)
+ *
+ *   ISR ADC_vect n=3700 min=98 avg=112 max=140 lat=35 load=20.7%
+ *
+ * The load is the vector's share of the CPU over the window, in the same
+ * body-only cycles as the durations.
+ */
+void profile_dump(void)
+{
+    uint32_t window_end = timer1_get_ticks32();
+    uint32_t window_per_mille = (window_end - profile_window_start) / 1000;
+    profile_window_start = window_end;
+
+    usart_transmit_string_P(PSTR("Profile (cycles @ F_CPU):\r\n"));
+    for (uint8_t id = 0; id < PROFILE_ID_COUNT; id++) {
+        // Snapshot one vector at a time so interrupts are only held off briefly
+        uint8_t sreg = SREG;
+        cli();
+        profile_stats_t stats = profile_stats[id];
+        profile_stats[id].min = 0;
+        profile_stats[id].max = 0;
+        profile_stats[id].total = 0;
+        profile_stats[id].count = 0;
+        profile_stats[id].latency_max = 0;
+        SREG = sreg;
+
+        usart_transmit_string_P(PSTR("ISR "));
+        usart_transmit_string_P(pgm_read_ptr(&profile_names[id]));
+        usart_transmit_string_P(PSTR(" n="));
+        usart_transmit_number(stats.count);
+        usart_transmit_string_P(PSTR(" min="));
+        usart_transmit_number(stats.min);
+        usart_transmit_string_P(PSTR(" avg="));
+        usart_transmit_number(stats.count ? stats.total / stats.count : 0);
+        usart_transmit_string_P(PSTR(" max="));
+        usart_transmit_number(stats.max);
+        usart_transmit_string_P(PSTR(" lat="));
+        if (PROFILE_LATENCY_MASK & (1 << id)) {
+            usart_transmit_number(stats.latency_max);
+        } else {
+            usart_transmit('-');
+        }
+        usart_transmit_string_P(PSTR(" load="));
+        usart_transmit_fixed(window_per_mille ? stats.total / window_per_mille : 0, 1);
+        usart_transmit_string_P(PSTR("%\r\n"));
+    }
+    usart_transmit_string_P(PSTR("---\r\n"));
+}
+
+#else
+
+void profile_reset(void)
+{
+}
+
+void profile_dump(void)
+{
+}
+
+#endif // PROFILE_ISR
@@ -0,0 +1,51 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <avr/io.h>
+#include <stdint.h>
+#include "config.h"
+
+/*
+ * ISR timing instrumentation (compiled in when PROFILE_ISR is 1)
+ *
+ * Entry and exit are timestamped with free-running Timer1 (one tick per CPU
+ * cycle at prescaler 1). Durations exclude the compiler's register save and
+ * restore around the ISR body. Latency is recorded where the instant the
+ * interrupt became due is known from Timer1: ADC_vect (compare B trigger
+ * plus conversion time) and TIMER0_COMPA_vect (its fixed period).
+ */
+
+// Profiled vectors
+#define PROFILE_ID_ADC    0
+#define PROFILE_ID_INT0   1
+#define PROFILE_ID_TIMER0 2
+#define PROFILE_ID_SPI    3   // Display latch (DISPLAY_TRANSPORT_SPI)
+#define PROFILE_ID_COUNT  4
+
+#if PROFILE_ISR
+
+// Declares the entry timestamp; must be the first statement of the ISR
+#define PROFILE_ISR_ENTER() uint16_t profile_entry_ticks = TCNT1
+// Records the time since PROFILE_ISR_ENTER(); place before every return
+#define PROFILE_ISR_EXIT(id) profile_record_duration((id), (uint16_t)(TCNT1 - profile_entry_ticks))
+// Records how long after 'due_ticks' (Timer1) the ISR was entered
+#define PROFILE_ISR_LATENCY(id, due_ticks) profile_record_latency((id), (int16_t)(profile_entry_ticks - (uint16_t)(due_ticks)))
+// Timer1 timestamp of the current ISR entry
+#define PROFILE_ISR_ENTRY_TICKS() (profile_entry_ticks)
+
+void profile_record_duration(uint8_t id, uint16_t ticks);
+void profile_record_latency(uint8_t id, int16_t ticks);
+
+#else
+
+#define PROFILE_ISR_ENTER() do { } while (0)
+#define PROFILE_ISR_EXIT(id) do { } while (0)
+#define PROFILE_ISR_LATENCY(id, due_ticks) do { } while (0)
+
+#endif // PROFILE_ISR
+
+// Function declarations (no-ops when PROFILE_ISR is 0)
+void profile_reset(void);
+void profile_dump(void);
+
+#endif // PROFILE_H
@@ -0,0 +1,205 @@
+#include "sched.h"
+#include "timer.h"
+#include "uart.h"
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <avr/sleep.h>
+
+_Static_assert(SCHED_TASK_COUNT <= 8, "sched_events has one bit per task");
+
+typedef struct {
+    sched_task_fn_t run;
+    const char *name;       // Flash
+    uint16_t period_ms;     // 0 = released by events only
+    uint16_t due_ms;        // Next periodic release
+    uint32_t runs;
+    uint32_t total_ticks;
+    uint32_t max_ticks;
+    uint16_t overruns;
+} sched_task_t;
+
+static sched_task_t sched_tasks[SCHED_TASK_COUNT];
+
+// Pending event bits, one per task (sched_trigger())
+static volatile uint8_t sched_events = 0;
+
+// Timer1 ticks spent asleep, and the start of the statistics window
+static uint32_t sched_idle_ticks = 0;
+static uint32_t sched_window_start = 0;
+
+void sched_init(void)
+{
+    for (uint8_t id = 0; id < SCHED_TASK_COUNT; id++) {
+        sched_tasks[id].run = 0;
+        sched_tasks[id].period_ms = 0;
+    }
+    sched_events = 0;
+    sched_idle_ticks = 0;
+    sched_window_start = timer1_get_ticks32();
+    set_sleep_mode(SLEEP_MODE_IDLE);  // Timers, ADC, UART and SPI keep running
+}
+
+/*
+ * Registers task 'id'; 'period_ms' 0 makes it event-only, otherwise it is
+ * first released one period from now. 'name_P' (flash) appears in the dump.
+ */
+void sched_add(uint8_t id, const char *name_P, sched_task_fn_t run, uint16_t period_ms)
+{
+    sched_task_t *task = &sched_tasks[id];
+
+    task->run = run;
+    task->name = name_P;
+    task->period_ms = period_ms;
+    task->due_ms = timer0_get_ms() + period_ms;
+    task->runs = 0;
+    task->total_ticks = 0;
+    task->max_ticks = 0;
+    task->overruns = 0;
+}
+
+// Releases task 'id' once (ISRs or the main loop)
+void sched_trigger(uint8_t id)
+{
+    uint8_t mask = (uint8_t)(1 << id);
+    uint8_t sreg = SREG;
+    cli();
+    if (sched_events & mask) {
+        sched_tasks[id].overruns++;   // The previous event is still unhandled
+    }
+    sched_events |= mask;
+    SREG = sreg;
+}
+
+// Returns 1 if the periodic release of 'task' is due at 'now'
+static uint8_t sched_is_due(const sched_task_t *task, uint16_t now)
+{
+    return task->period_ms != 0 && (int16_t)(now - task->due_ms) >= 0;
+}
+
+/*
+ * Runs the highest-priority ready task to completion; returns 0 if none
+ * was ready
+ *
+ * A periodic task keeps its phase (next release = this one + period)
+ * unless it started a whole period late: then the missed releases count
+ * as overruns and the next one is a period from now.
+ */
+uint8_t sched_dispatch(void)
+{
+    uint16_t now = timer0_get_ms();
+
+    for (uint8_t id = 0; id < SCHED_TASK_COUNT; id++) {
+        sched_task_t *task = &sched_tasks[id];
+        uint8_t mask = (uint8_t)(1 << id);
+        uint8_t released = 0;
+
+        uint8_t sreg = SREG;
+        cli();
+        if (sched_events & mask) {
+            sched_events &= (uint8_t)~mask;
+            released = 1;
+        }
+        SREG = sreg;
+
+        if (sched_is_due(task, now)) {
+            uint16_t late = now - task->due_ms;
+            if (late >= task->period_ms) {
+                task->overruns += late / task->period_ms;
+                task->due_ms = now + task->period_ms;
+            } else {
+                task->due_ms += task->period_ms;
+            }
+            released = 1;
+        }
+
+        if (released && task->run != 0) {
+            uint32_t start = timer1_get_ticks32();
+            task->run();
+            uint32_t ticks = timer1_get_ticks32() - start;
+
+            task->runs++;
+            task->total_ticks += ticks;
+            if (ticks > task->max_ticks) {
+                task->max_ticks = ticks;
+            }
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Sleeps until the next interrupt if no task is ready
+ *
+ * The check runs with interrupts disabled and sei() takes effect only
+ * after the following instruction, so an event raised after the check
+ * still wakes the CPU from this sleep instead of waiting for the next one.
+ * The idle time includes the ISR that ends the sleep.
+ */
+void sched_idle(void)
+{
+    cli();
+    uint16_t now = timer0_get_ms();
+    uint8_t ready = sched_events;
+
+    for (uint8_t id = 0; id < SCHED_TASK_COUNT; id++) {
+        ready |= sched_is_due(&sched_tasks[id], now);
+    }
+    if (!ready) {
+        uint32_t start = timer1_get_ticks32();
+        sleep_enable();
+        sei();
+        sleep_cpu();
+        sleep_disable();
+        sched_idle_ticks += timer1_get_ticks32() - start;
+    }
+    sei();
+}
+
+/*
+ * Sends the task statistics collected since the last dump, then starts a
+ * new window
+ *
+ *   Tasks (cycles @ F_CPU), idle 81.2%:
+ *   metrics n=50 avg=15210 max=16480 over=0
+ */
+void sched_dump(void)
+{
+    uint32_t window_end = timer1_get_ticks32();
+    uint32_t window_per_mille = (window_end - sched_window_start) / 1000;
+
+    usart_transmit_string_P(PSTR("Tasks (cycles @ F_CPU), idle "));
+    usart_transmit_fixed(window_per_mille ? sched_idle_ticks / window_per_mille : 0, 1);
+    usart_transmit_string_P(PSTR("%:\r\n"));
+    sched_window_start = window_end;
+    sched_idle_ticks = 0;
+
+    for (uint8_t id = 0; id < SCHED_TASK_COUNT; id++) {
+        sched_task_t *task = &sched_tasks[id];
+
+        if (task->run == 0) {
+            continue;
+        }
+        uint8_t sreg = SREG;
+        cli();
+        uint16_t overruns = task->overruns;  // Also counted in sched_trigger()
+        task->overruns = 0;
+        SREG = sreg;
+
+        usart_transmit_string_P(task->name);
+        usart_transmit_string_P(PSTR(" n="));
+        usart_transmit_number(task->runs);
+        usart_transmit_string_P(PSTR(" avg="));
+        usart_transmit_number(task->runs ? task->total_ticks / task->runs : 0);
+        usart_transmit_string_P(PSTR(" max="));
+        usart_transmit_number(task->max_ticks);
+        usart_transmit_string_P(PSTR(" over="));
+        usart_transmit_number(overruns);
+        usart_transmit_string_P(PSTR("\r\n"));
+
+        task->runs = 0;
+        task->total_ticks = 0;
+        task->max_ticks = 0;
+    }
+    usart_transmit_string_P(PSTR("---\r\n"));
+}
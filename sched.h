@@ -0,0 +1,42 @@
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <avr/io.h>
+#include <stdint.h>
+#include "config.h"
+
+/*
+ * Run-to-completion task scheduler for the main loop
+ *
+ * A task is released by an event (sched_trigger(), usually from an ISR),
+ * by its period on the Timer0 millisecond timebase, or both. The main loop
+ * runs the ready task with the lowest ID, one at a time and each to
+ * completion, and sleeps in idle mode when none is ready; any interrupt
+ * wakes it, the next Timer0 slot at the latest.
+ *
+ * Per task: runs, average and worst run time in Timer1 ticks (CPU cycles,
+ * including ISRs that preempt it), and overruns: releases a periodic task
+ * missed by starting a whole period or more late, or an event raised again
+ * before the task had handled the previous one.
+ */
+
+// Tasks, highest priority first (at most 8)
+#define SCHED_TASK_METRICS   0   // Event (ADC_vect): reduce the completed bank
+#define SCHED_TASK_TELEMETRY 1   // Event (METRICS): binary frame, then release the bank
+#define SCHED_TASK_COMMAND   2   // Event (USART_RX_vect): run the received line
+#define SCHED_TASK_DISPLAY   3   // DISPLAY_UPDATE_MS: stale check, scroll, text report
+#define SCHED_TASK_EVENTLOG  4   // SCHED_EVENTLOG_MS: format queued log events
+#define SCHED_TASK_ENERGY    5   // SCHED_ENERGY_MS: EEPROM checkpoint when due
+#define SCHED_TASK_COUNT     6
+
+typedef void (*sched_task_fn_t)(void);
+
+// Function declarations
+void sched_init(void);
+void sched_add(uint8_t id, const char *name_P, sched_task_fn_t run, uint16_t period_ms);
+void sched_trigger(uint8_t id);
+uint8_t sched_dispatch(void);
+void sched_idle(void);
+void sched_dump(void);
+
+#endif // SCHED_H
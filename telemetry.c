@@ -0,0 +1,232 @@
+#include "telemetry.h"
+#include "uart.h"
+#include "adc.h"
+#include "int0.h"
+#include "powercalc.h"
+#include "energy.h"
+#include <avr/interrupt.h>
+#include <util/crc16.h>
+
+_Static_assert(TELEMETRY_MEASUREMENT_SIZE + 1 <= TELEMETRY_MAX_PAYLOAD
+    && TELEMETRY_WAVEFORM_SIZE(SAMPLE_BUFFER_SIZE) + 1 <= TELEMETRY_MAX_PAYLOAD,
+    "Telemetry payload larger than TELEMETRY_MAX_PAYLOAD");
+
+static uint8_t telemetry_format = TELEMETRY_FORMAT_DEFAULT;
+static uint16_t frames_skipped = 0;
+static uint16_t skipped_reported = 0;
+static uint16_t dropped_reported = 0;
+static uint16_t tx_lost_reported = 0;
+
+void telemetry_init(void)
+{
+    telemetry_format = TELEMETRY_FORMAT_DEFAULT;
+    frames_skipped = 0;
+    skipped_reported = 0;
+    dropped_reported = adc_get_dropped_cycles();
+    tx_lost_reported = usart_tx_get_dropped();
+}
+
+// Selects the output format; waveform frames need the buffered raw samples
+void telemetry_set_format(uint8_t format)
+{
+#if ADC_ACCUMULATION_MODE == ADC_ACCUM_STREAMING
+    if (format == TELEMETRY_FORMAT_WAVEFORM) {
+        return;
+    }
+#endif
+    telemetry_format = format;
+}
+
+uint8_t telemetry_get_format(void)
+{
+    return telemetry_format;
+}
+
+// Measurement frames not sent because the transmit buffer was full
+uint16_t telemetry_get_skipped(void)
+{
+    return frames_skipped;
+}
+
+static void put_u16(uint8_t *buffer, uint8_t offset, uint16_t value)
+{
+    buffer[offset] = (uint8_t)value;
+    buffer[offset + 1] = (uint8_t)(value >> 8);
+}
+
+static void put_u32(uint8_t *buffer, uint8_t offset, uint32_t value)
+{
+    put_u16(buffer, offset, (uint16_t)value);
+    put_u16(buffer, offset + 2, (uint16_t)(value >> 16));
+}
+
+// Report header shared by measurement and waveform frames (see telemetry.h)
+static void put_header(uint8_t *buffer, uint8_t bank, uint16_t dropped)
+{
+    put_u32(buffer, 0, powercalc_get_sequence());
+    put_u32(buffer, 4, adc_get_bank_start_ticks(bank));
+    put_u16(buffer, 8, adc_get_completed_cycles());
+    put_u16(buffer, 10, dropped);
+    put_u16(buffer, 12, int0_get_busy_triggers());
+    put_u16(buffer, 14, powercalc_get_stale_reports());
+}
+
+/*
+ * Sends one frame: type, payload and CRC-16, COBS-encoded, then 0x00
+ *
+ * Non-blocking: returns 0 without sending anything if the UART transmit
+ * buffer cannot take the whole encoded frame, so frames are never cut.
+ */
+uint8_t telemetry_send_frame(uint8_t type, const uint8_t *payload, uint8_t length)
+{
+    uint8_t frame[1 + TELEMETRY_MAX_PAYLOAD + 2];
+    uint8_t frame_length = length + 3;
+    uint16_t crc = 0;
+
+    if (length > TELEMETRY_MAX_PAYLOAD
+        || usart_tx_free() < TELEMETRY_ENCODED_SIZE((uint16_t)length + 1)) {
+        return 0;
+    }
+
+    frame[0] = type;
+    for (uint8_t i = 0; i < length; i++) {
+        frame[1 + i] = payload[i];
+    }
+    for (uint8_t i = 0; i < length + 1; i++) {
+        crc = _crc_xmodem_update(crc, frame[i]);
+    }
+    put_u16(frame, length + 1, crc);
+
+    // COBS: each block is a code byte (1 + number of data bytes that
+    // follow, 0xFF for a full 254-byte run) standing in for the next zero
+    uint8_t start = 0;
+    for (;;) {
+        uint8_t end = start;
+        while (end < frame_length && frame[end] != 0 && (uint8_t)(end - start) < 254) {
+            end++;
+        }
+        usart_tx_enqueue((uint8_t)(end - start + 1));
+        for (uint8_t i = start; i < end; i++) {
+            usart_tx_enqueue(frame[i]);
+        }
+        if (end >= frame_length) {
+            break;
+        }
+        if (frame[end] == 0) {
+            start = end + 1;
+            if (start == frame_length) {
+                usart_tx_enqueue(1);  // Trailing zero: empty final block
+                break;
+            }
+        } else {
+            start = end;  // Full run, no zero consumed
+        }
+    }
+    usart_tx_enqueue(0);
+    return 1;
+}
+
+/*
+ * Sends the metrics of the sequence in 'bank' (main loop, after
+ * calculate_sample_metrics() and before the bank is released)
+ */
+void telemetry_send_measurement(uint8_t bank)
+{
+    uint8_t payload[TELEMETRY_MEASUREMENT_SIZE];
+    uint8_t flags = 0;
+    uint16_t dropped = adc_get_dropped_cycles();
+    uint16_t tx_lost = usart_tx_get_dropped();
+
+    if (is_display_data_ready()) {
+        flags |= TELEMETRY_FLAG_VALID;
+    }
+    if (dropped != dropped_reported) {
+        flags |= TELEMETRY_FLAG_CYCLES_DROPPED;
+    }
+    if (frames_skipped != skipped_reported) {
+        flags |= TELEMETRY_FLAG_FRAMES_SKIPPED;
+    }
+    if (tx_lost != tx_lost_reported) {
+        flags |= TELEMETRY_FLAG_TX_LOST;
+    }
+    if (energy_is_checkpoint_busy()) {
+        flags |= TELEMETRY_FLAG_CHECKPOINT_BUSY;
+    }
+
+    put_header(payload, bank, dropped);
+    payload[16] = flags;
+    put_u32(payload, 17, get_average_power_mW());
+    put_u32(payload, 21, get_rms_voltage_mV());
+    put_u16(payload, 25, get_rms_current_dmA());
+    put_u16(payload, 27, get_peak_current_dmA());
+    put_u16(payload, 29, adc_get_offset_filtered());
+    put_u16(payload, 31, int0_get_line_period());
+    put_u32(payload, 33, energy_get_mWh());
+
+    if (telemetry_send_frame(TELEMETRY_FRAME_MEASUREMENT, payload, sizeof(payload))) {
+        dropped_reported = dropped;
+        skipped_reported = frames_skipped;
+        tx_lost_reported = tx_lost;
+    } else {
+        frames_skipped++;
+    }
+}
+
+#if ADC_ACCUMULATION_MODE == ADC_ACCUM_BUFFERED
+/*
+ * Sends the raw samples of the sequence in 'bank' plus the latest offset
+ * conversion, 4 values per 5 bytes (main loop, before the bank is released)
+ */
+void telemetry_send_waveform(uint8_t bank)
+{
+    uint8_t payload[TELEMETRY_WAVEFORM_SIZE(SAMPLE_BUFFER_SIZE)];
+    uint8_t samples = adc_get_bank_samples(bank);
+    uint8_t values = TELEMETRY_WAVEFORM_VALUES(samples);
+    uint8_t *group = &payload[TELEMETRY_HEADER_SIZE + 1];
+    uint8_t slot = 0;
+
+    put_header(payload, bank, adc_get_dropped_cycles());
+    payload[TELEMETRY_HEADER_SIZE] = samples;
+
+    for (uint8_t n = 0; n < (uint8_t)((values + 3) & ~3); n++) {
+        uint16_t value = 0;
+        if (n < samples) {
+            value = voltage_samples_raw[bank][n];
+        } else if (n < 2 * samples) {
+            value = current_samples_raw[bank][n - samples];
+        } else if (n == 2 * samples) {
+            uint8_t sreg = SREG;
+            cli();
+            value = offset_sample;
+            SREG = sreg;
+        }
+
+        if (slot == 0) {
+            group[4] = 0;
+        }
+        group[slot] = (uint8_t)value;
+        group[4] |= (uint8_t)((value >> 8) & 0x03) << (2 * slot);
+        if (++slot == 4) {
+            slot = 0;
+            group += 5;
+        }
+    }
+
+    if (!telemetry_send_frame(TELEMETRY_FRAME_WAVEFORM, payload, TELEMETRY_WAVEFORM_SIZE(samples))) {
+        frames_skipped++;
+    }
+}
+#endif
+
+// Sends the frame the current format asks for after each measured sequence
+void telemetry_send_sequence(uint8_t bank)
+{
+    if (telemetry_format == TELEMETRY_FORMAT_BINARY) {
+        telemetry_send_measurement(bank);
+    }
+#if ADC_ACCUMULATION_MODE == ADC_ACCUM_BUFFERED
+    else if (telemetry_format == TELEMETRY_FORMAT_WAVEFORM) {
+        telemetry_send_waveform(bank);
+    }
+#endif
+}
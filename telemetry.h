@@ -0,0 +1,109 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <avr/io.h>
+#include <stdint.h>
+#include "config.h"
+
+/*
+ * Binary telemetry frames
+ *
+ * Wire format of every frame:
+ *
+ *   COBS( type | payload | CRC-16 ) 0x00
+ *
+ * The CRC is CRC-16/XMODEM (polynomial 0x1021, initial 0) over type and
+ * payload, sent little-endian like every other multi-byte field. COBS
+ * removes all zero bytes, so 0x00 only ever marks the end of a frame and a
+ * receiver can resynchronise on it.
+ */
+
+// Output formats (TELEMETRY_FORMAT_DEFAULT in config.h, or at run time)
+#define TELEMETRY_FORMAT_TEXT   0   // Human readable report once per DISPLAY_UPDATE_MS
+#define TELEMETRY_FORMAT_BINARY 1   // One measurement frame per sequence
+#define TELEMETRY_FORMAT_WAVEFORM 2 // One raw waveform frame per sequence (buffered mode only)
+
+// Frame types
+#define TELEMETRY_FRAME_MEASUREMENT 0x01
+#define TELEMETRY_FRAME_EVENT       0x02
+#define TELEMETRY_FRAME_WAVEFORM    0x03
+#define TELEMETRY_FRAME_REPLY       0x04   // Command reply text, no terminator
+
+// Largest type + payload accepted by telemetry_send_frame()
+#define TELEMETRY_MAX_PAYLOAD 128
+
+// Worst-case bytes on the wire for 'len' bytes of type + payload:
+// CRC, one COBS code byte per 254 data bytes (plus one), delimiter
+#define TELEMETRY_ENCODED_SIZE(len) ((len) + 2 + ((len) + 2) / 254 + 1 + 1)
+
+// Measurement frame status flags
+#define TELEMETRY_FLAG_VALID           0x01   // Metrics come from a measured sequence
+#define TELEMETRY_FLAG_CYCLES_DROPPED  0x02   // Mains cycles dropped since the last frame
+#define TELEMETRY_FLAG_FRAMES_SKIPPED  0x04   // Frames skipped (link full) since the last frame
+#define TELEMETRY_FLAG_TX_LOST         0x08   // UART bytes lost since the last frame
+#define TELEMETRY_FLAG_CHECKPOINT_BUSY 0x10   // EEPROM energy checkpoint in progress
+
+/*
+ * Measurement and waveform frames start with the same report header,
+ * little-endian:
+ *
+ *   off size field
+ *     0  4   result sequence number (powercalc_get_sequence(), +1 per
+ *            measured sequence; gaps = results not sent)
+ *     4  4   timestamp, Timer1 ticks (F_CPU) of the sequence's INT0 edge
+ *     8  2   sequences completed (adc_get_completed_cycles())
+ *    10  2   mains cycles dropped (adc_get_dropped_cycles())
+ *    12  2   INT0 edges ignored while busy (int0_get_busy_triggers())
+ *    14  2   stale report periods (powercalc_get_stale_reports())
+ *
+ * The counters are totals since power-up and wrap at 16 bits.
+ */
+#define TELEMETRY_HEADER_SIZE 16
+
+/*
+ * Measurement frame payload (after the type byte):
+ *
+ *   off size field
+ *     0  16  report header
+ *    16  1   status flags (TELEMETRY_FLAG_*)
+ *    17  4   average power, mW
+ *    21  4   RMS voltage, mV
+ *    25  2   RMS current, 0.1 mA
+ *    27  2   peak current, 0.1 mA
+ *    29  2   offset reference, Q6 ADC counts
+ *    31  2   line period, Timer1 ticks
+ *    33  4   energy, mWh
+ */
+#define TELEMETRY_MEASUREMENT_SIZE 37
+
+// Event frame payload: code | level << 5, tag, arg0 (2), arg1 (2)
+#define TELEMETRY_EVENT_SIZE 6
+
+/*
+ * Waveform frame payload (after the type byte):
+ *
+ *   off size field
+ *     0  16  report header
+ *    16  1   samples per channel n (adc_set_sampling(), at most SAMPLE_BUFFER_SIZE)
+ *    17  ..  packed raw ADC values: V[0..n-1], I[0..n-1], offset
+ *
+ * Packing: every 4 values take 5 bytes, the low 8 bits of each value
+ * followed by one byte with their top 2 bits (value 0 in bits 1:0, value 3
+ * in bits 7:6). The last group is padded with zero values.
+ */
+#define TELEMETRY_WAVEFORM_VALUES(n) (2 * (n) + 1)
+#define TELEMETRY_WAVEFORM_SIZE(n) (TELEMETRY_HEADER_SIZE + 1 + (TELEMETRY_WAVEFORM_VALUES(n) + 3) / 4 * 5)
+
+// Function declarations
+void telemetry_init(void);
+void telemetry_set_format(uint8_t format);
+uint8_t telemetry_get_format(void);
+uint8_t telemetry_send_frame(uint8_t type, const uint8_t *payload, uint8_t length);
+void telemetry_send_measurement(uint8_t bank);
+#if ADC_ACCUMULATION_MODE == ADC_ACCUM_BUFFERED
+void telemetry_send_waveform(uint8_t bank);
+#endif
+void telemetry_send_sequence(uint8_t bank);
+uint16_t telemetry_get_skipped(void);
+
+#endif // TELEMETRY_H
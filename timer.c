@@ -2,68 +2,152 @@
 #include "timer.h"
 #include "adc.h"
 #include "display.h"
+#include "profile.h"
 #include <avr/interrupt.h>
 
-// Global variables (none needed for current implementation)
+// Millisecond timebase, advanced by TIMER0_SLOT_US per compare match
+static volatile uint16_t timer0_ms = 0;
+static uint16_t timer0_us = 0;      // Sub-millisecond remainder (ISR only)
+
+// Timer1 overflow count: upper half of the 32-bit tick timestamp
+static volatile uint16_t timer1_overflows = 0;
+
+#if PROFILE_ISR
+// Timer0 compare period in Timer1 ticks (both run from the CPU clock)
+#define TIMER0_PERIOD_TICKS ((uint16_t)((TIMER0_COMPARE_VALUE + 1) * (uint32_t)TIMER0_PRESCALER))
+
+// Predicted Timer1 instant of the last Timer0 compare match
+static uint16_t timer0_due_ticks = 0;
+static uint8_t timer0_due_valid = 0;
+#endif
 
 
 /*
- * Initialize Timer0 for 10ms interrupt
- * Timer0 will trigger ISR every 10ms to update display
+ * Initialize Timer0 for the display multiplex slot
+ * Timer0 triggers the ISR TIMER0_SLOT_HZ times a second, one digit each
  */
 void timer0_init(void)
 {
     // Configure Timer0 for CTC mode (Clear Timer on Compare)
     TCCR0A = (1 << WGM01);  // CTC mode
     
-    // Set prescaler to 1024 and start timer
-    // For 2MHz clock: 2MHz / 1024 = 1953.125 Hz
-    // To get 10ms: 1953.125 / 100 = 19.53 ≈ 20
-    // OCR0A = 19 for 10ms interrupt
-    TCCR0B = (1 << CS02) | (1 << CS00);  // Prescaler 1024
-    OCR0A = 19;  // Compare value for ~10ms interrupt
+    // Prescaler and compare value from DISPLAY_REFRESH_HZ (timer.h)
+    // For 2MHz clock and 125 Hz: 2MHz / 64 = 31250 Hz
+    // To get 500 slots per second: 31250 / 500 = 62.5 ≈ 63
+    // OCR0A = 62 for a 2.016ms slot
+    TCCR0B = TIMER0_CLOCK_SELECT;
+    OCR0A = TIMER0_COMPARE_VALUE;
     
-    // Enable Timer0 compare A interrupt
-    TIMSK0 = (1 << OCIE0A);
+    // Enable Timer0 compare A interrupt (compare B belongs to the display
+    // brightness, set up by init_display())
+    TIMSK0 |= (1 << OCIE0A);
 }
 
 void timer1_init(void){
 	TCCR1A = 0;
 	TCCR1B = 0;
 	
-	// set timer1 to CTC mode
-	TCCR1B |= (1 << WGM12);
-	
-	//set the compare value for the 108us interval
-	OCR1A = 215; 
-	//set the compare match B value which is for ADC auto-trigger.
-	OCR1B = 215;
+	// Timer1 runs free in normal mode at F_CPU (prescaler 1): one tick is
+	// 0.5us and the counter wraps every 32.8ms. INT0 timestamps zero-crossings
+	// against it and ADC_vect schedules each conversion through OCR1B.
+	TCCR1B |= (1 << CS10);
+	TCCR1B &= ~((1 << CS12) | (1 << CS11));
 	
-	TCCR1B &= ~((1 << CS12) | (1 << CS11) | (1 << CS10));	
+	// Count overflows to extend the timestamp to 32 bits (wraps every ~36 minutes)
+	timer1_overflows = 0;
+	TIMSK1 |= (1 << TOIE1);
 }
 
-void timer1_start(void){
-	//reset timer counter to 0
-	TCNT1 = 0;
-	
-	//set prescaler to 1
-	TCCR1B |= (1 << CS10);
-	TCCR1B &= ~((1 << CS12) | (1 << CS11));
+// Current Timer1 count (atomic 16-bit read)
+uint16_t timer1_get_ticks(void)
+{
+	uint8_t sreg = SREG;
+	cli();
+	uint16_t ticks = TCNT1;
+	SREG = sreg;
+	return ticks;
 }
 
-void timer1_stop(void){
-	//stop timer1
-	TCCR1B &= ~((1 << CS12) | (1 << CS11) | (1 << CS10));
+/*
+ * 32-bit Timer1 timestamp
+ *
+ * If the counter has wrapped but TIMER1_OVF_vect has not run yet (interrupts
+ * disabled by the caller or by this function), TOV1 is still pending and a
+ * small TCNT1 belongs to the next overflow period.
+ */
+uint32_t timer1_get_ticks32(void)
+{
+	uint8_t sreg = SREG;
+	cli();
+	uint16_t high = timer1_overflows;
+	uint16_t low = TCNT1;
+	if ((TIFR1 & (1 << TOV1)) && low < 0x8000) {
+		high++;
+	}
+	SREG = sreg;
+	return ((uint32_t)high << 16) | low;
+}
+
+// Sets the compare match B instant used as the ADC auto-trigger and re-arms it
+void timer1_set_compare_b(uint16_t ticks)
+{
+	OCR1B = ticks;
+	timer1_clear_compare_match_b_flag();
+}
+
+// Moves the ADC auto-trigger 'step' ticks past the previous one and re-arms it
+void timer1_advance_compare_b(uint16_t step)
+{
+	OCR1B += step;
+	timer1_clear_compare_match_b_flag();
 }
 
 void timer1_clear_compare_match_b_flag(void)
 {
     // Clear the Timer1 Compare Match B interrupt flag by writing a logic one to OCF1B
-    TIFR1 |= (1 << OCF1B);
+    // (plain write: a read-modify-write would also clear any other pending flag)
+    TIFR1 = (1 << OCF1B);
+}
+
+// Returns the time in milliseconds, in steps of one Timer0 slot (~2ms);
+// wraps every ~65s, compare with unsigned subtraction
+uint16_t timer0_get_ms(void)
+{
+    uint8_t sreg = SREG;
+    cli();
+    uint16_t ms = timer0_ms;
+    SREG = sreg;
+    return ms;
+}
+
+// Timer1 Overflow Interrupt Service Routine - extends the timestamp
+ISR(TIMER1_OVF_vect)
+{
+    timer1_overflows++;
 }
 
 // Timer0 Compare A Interrupt Service Routine
 ISR(TIMER0_COMPA_vect)
 {
+    PROFILE_ISR_ENTER();
+#if PROFILE_ISR
+    // Matches are exactly TIMER0_PERIOD_TICKS apart; the earliest entry seen
+    // becomes the reference, so latency is relative to the fastest response
+    uint16_t due = timer0_due_ticks + TIMER0_PERIOD_TICKS;
+    if (!timer0_due_valid || (int16_t)(PROFILE_ISR_ENTRY_TICKS() - due) < 0) {
+        due = PROFILE_ISR_ENTRY_TICKS();
+        timer0_due_valid = 1;
+    }
+    timer0_due_ticks = due;
+    PROFILE_ISR_LATENCY(PROFILE_ID_TIMER0, due);
+#endif
+    // Whole milliseconds of the slot, plus one whenever the remainder carries
+    timer0_ms += TIMER0_SLOT_US / 1000;
+    timer0_us += TIMER0_SLOT_US % 1000;
+    if (timer0_us >= 1000) {
+        timer0_us -= 1000;
+        timer0_ms++;
+    }
     send_next_character_to_display();
+    PROFILE_ISR_EXIT(PROFILE_ID_TIMER0);
 }
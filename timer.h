@@ -3,12 +3,42 @@
 
 #include <avr/io.h>
 #include <stdint.h>
+#include "config.h"
 
+// Timer0 compare period: one multiplex slot (one digit), also the main-loop tick.
+// Prescaler 8 when the slot fits in 256 counts, 64 otherwise; at 2MHz and
+// 125 Hz: (62 + 1) * 64 / 2MHz = 2.016ms per slot, 124 Hz per frame.
+#define TIMER0_SLOT_HZ (DISPLAY_REFRESH_HZ * DISPLAY_DIGITS)
+#if F_CPU / 8 / TIMER0_SLOT_HZ <= 256
+#define TIMER0_PRESCALER 8
+#define TIMER0_CLOCK_SELECT (1 << CS01)
+#else
+#define TIMER0_PRESCALER 64
+#define TIMER0_CLOCK_SELECT ((1 << CS01) | (1 << CS00))
+#endif
+#define TIMER0_COMPARE_VALUE ((F_CPU / TIMER0_PRESCALER + TIMER0_SLOT_HZ / 2) / TIMER0_SLOT_HZ - 1)
+
+// Timer0 slot in microseconds, for the millisecond timebase (2016us at 125 Hz)
+#define TIMER0_SLOT_US ((uint16_t)((TIMER0_COMPARE_VALUE + 1) * TIMER0_PRESCALER * 1000000ULL / F_CPU))
+
+_Static_assert(DISPLAY_REFRESH_HZ >= 100, "DISPLAY_REFRESH_HZ below 100 Hz flickers");
+_Static_assert(TIMER0_COMPARE_VALUE <= 255, "DISPLAY_REFRESH_HZ too low for Timer0 at prescaler 64");
+_Static_assert(DISPLAY_REFRESH_HZ <= 250, "DISPLAY_REFRESH_HZ above 250 Hz: the display would take over 13% of the CPU");
+_Static_assert(TIMER0_COMPARE_VALUE + 1 >= 2 * DISPLAY_BRIGHTNESS_MAX,
+    "DISPLAY_REFRESH_HZ too high: a slot needs two Timer0 counts per brightness level");
+_Static_assert((TIMER0_COMPARE_VALUE + 1) * TIMER0_PRESCALER * 1000000ULL % F_CPU == 0,
+    "Timer0 slot must be a whole number of microseconds for the millisecond timebase");
+
+// Timer1 free-running tick rate (prescaler 1)
+#define TIMER1_TICKS_PER_SECOND F_CPU
 
 // Function declarations
 void timer0_init(void);
 void timer1_init(void);
-void timer1_start(void);
-void timer1_stop(void);
+uint16_t timer1_get_ticks(void);
+uint32_t timer1_get_ticks32(void);
+void timer1_set_compare_b(uint16_t ticks);
+void timer1_advance_compare_b(uint16_t step);
 void timer1_clear_compare_match_b_flag(void);
+uint16_t timer0_get_ms(void);
 #endif // TIMER_H
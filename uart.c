@@ -1,29 +1,208 @@
 #include "uart.h"
 #include "powercalc.h"
+#include "adc.h"
+#include "int0.h"
+#include "energy.h"
+#include "numfmt.h"
+#include "sched.h"
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
 #include <stdint.h>
 
+_Static_assert(UART_TX_BUFFER_SIZE >= 2 && UART_TX_BUFFER_SIZE <= 256
+    && (UART_TX_BUFFER_SIZE & UART_TX_BUFFER_MASK) == 0,
+    "UART_TX_BUFFER_SIZE must be a power of two between 2 and 256");
+_Static_assert(UART_BAUD_ERROR_ACTUAL <= UART_BAUD_MAX_ERROR,
+    "UART_BAUD_RATE cannot be generated from F_CPU within UART_BAUD_MAX_ERROR");
+_Static_assert(UART_UBRR_VALUE <= 4095, "UART_BAUD_RATE too low for F_CPU (UBRR0 is 12 bits)");
+
+/*
+ * Transmit ring buffer
+ *
+ * The main loop writes at tx_head, USART_UDRE_vect reads at tx_tail; each
+ * index has a single writer, except that UART_TX_DROP_OLDEST moves the tail
+ * from the producer side with interrupts disabled. Empty when head == tail,
+ * full when one slot is left.
+ */
+static volatile uint8_t tx_buffer[UART_TX_BUFFER_SIZE];
+static volatile uint8_t tx_head = 0;
+static volatile uint8_t tx_tail = 0;
+static volatile uint8_t tx_high_water = 0;
+static volatile uint16_t tx_dropped = 0;
+
+/*
+ * Receive line buffers
+ *
+ * USART_RX_vect appends characters to rx_line[rx_fill] and on CR or LF
+ * hands the line to the main loop (rx_ready) and switches to the other
+ * buffer, so the work per byte is constant. A line that ends while the main
+ * loop still holds the previous one, that does not fit, or that had a
+ * framing error or overrun is dropped and counted.
+ */
+static char rx_line[2][UART_RX_LINE_MAX];
+static volatile uint8_t rx_fill = 0;
+static volatile uint8_t rx_length = 0;
+static volatile uint8_t rx_ready = 0;
+static volatile uint8_t rx_discard = 0;
+static volatile uint16_t rx_dropped = 0;
+
+// Bytes queued and not yet handed to UDR0
+static inline uint8_t usart_tx_used(void)
+{
+    return (uint8_t)((tx_head - tx_tail) & UART_TX_BUFFER_MASK);
+}
+
+// Moves one byte into UDR0 without the interrupt (caller has interrupts off)
+static void usart_tx_drain_polled(void)
+{
+    while (!(UCSR0A & (1 << UDRE0)));
+    UDR0 = tx_buffer[tx_tail];
+    tx_tail = (tx_tail + 1) & UART_TX_BUFFER_MASK;
+}
+
 // UART Initialization
-void usart_init(uint8_t prescaler)
+void usart_init(void)
 {
-    // Set baud rate
-    UBRR0H = (uint8_t)(prescaler >> 8);
-    UBRR0L = (uint8_t)(prescaler);
+    // Set baud rate (divisor and double-speed mode chosen in uart.h)
+    UBRR0H = (uint8_t)(UART_UBRR_VALUE >> 8);
+    UBRR0L = (uint8_t)(UART_UBRR_VALUE);
+#if UART_USE_2X
+    UCSR0A = (1 << U2X0);
+#else
+    UCSR0A = 0;
+#endif
     
-    // Enable transmitter only (TX only mode)
-    UCSR0B = (1 << TXEN0);
+    // Enable transmitter, and the receiver with its interrupt for command lines
+    UCSR0B = (1 << TXEN0) | (1 << RXEN0) | (1 << RXCIE0);
     
     // Set frame format: 8 data bits, 1 stop bit, no parity
     UCSR0C = (1 << UCSZ01) | (1 << UCSZ00);
+
+    tx_head = 0;
+    tx_tail = 0;
+    tx_high_water = 0;
+    tx_dropped = 0;
+    rx_fill = 0;
+    rx_length = 0;
+    rx_ready = 0;
+    rx_discard = 0;
+    rx_dropped = 0;
+}
+
+/*
+ * Queues one byte for USART_UDRE_vect without waiting
+ *
+ * Returns 1 if the byte was queued. On a full buffer UART_TX_DROP_OLDEST
+ * discards the oldest byte to make room and UART_TX_DROP_NEWEST the new one,
+ * both counted as lost; under UART_TX_BLOCK it returns 0 so the caller can
+ * retry.
+ */
+uint8_t usart_tx_enqueue(uint8_t data)
+{
+    uint8_t sreg = SREG;
+    cli();
+    uint8_t next = (tx_head + 1) & UART_TX_BUFFER_MASK;
+
+    if (next == tx_tail) {
+#if UART_TX_OVERFLOW_POLICY == UART_TX_DROP_OLDEST
+        tx_tail = (tx_tail + 1) & UART_TX_BUFFER_MASK;
+        tx_dropped++;
+#else
+#if UART_TX_OVERFLOW_POLICY == UART_TX_DROP_NEWEST
+        tx_dropped++;
+#endif
+        SREG = sreg;
+        return 0;
+#endif
+    }
+    tx_buffer[tx_head] = data;
+    tx_head = next;
+
+    uint8_t used = usart_tx_used();
+    if (used > tx_high_water) {
+        tx_high_water = used;
+    }
+    UCSR0B |= (1 << UDRIE0);  // UDRE fires at once if the data register is empty
+    SREG = sreg;
+    return 1;
 }
 
-// Transmit single byte
+// Transmit single byte through the ring buffer, applying UART_TX_OVERFLOW_POLICY
 void usart_transmit(uint8_t data)
 {
-    // Wait for empty transmit buffer
-    while (!(UCSR0A & (1 << UDRE0)));
-    
-    // Put data into buffer, sends the data
-    UDR0 = data;
+#if UART_TX_OVERFLOW_POLICY == UART_TX_BLOCK
+    while (!usart_tx_enqueue(data)) {
+        // Full: USART_UDRE_vect frees a slot every character time. With
+        // interrupts disabled (ISR context) it cannot run, so send one here.
+        if (!(SREG & (1 << SREG_I))) {
+            usart_tx_drain_polled();
+        }
+    }
+#else
+    usart_tx_enqueue(data);  // Overflow already handled and counted
+#endif
+}
+
+// Free slots in the ring buffer
+uint8_t usart_tx_free(void)
+{
+    uint8_t sreg = SREG;
+    cli();
+    uint8_t free_slots = UART_TX_BUFFER_MASK - usart_tx_used();
+    SREG = sreg;
+    return free_slots;
+}
+
+// Waits until every queued byte has been handed to the USART
+void usart_tx_flush(void)
+{
+    while (usart_tx_free() != UART_TX_BUFFER_MASK) {
+        if (!(SREG & (1 << SREG_I))) {
+            usart_tx_drain_polled();
+        }
+    }
+}
+
+// Highest ring buffer fill level since usart_init()
+uint8_t usart_tx_get_high_water(void)
+{
+    return tx_high_water;
+}
+
+// Bytes lost to a full ring buffer since usart_init()
+uint16_t usart_tx_get_dropped(void)
+{
+    uint8_t sreg = SREG;
+    cli();
+    uint16_t dropped = tx_dropped;
+    SREG = sreg;
+    return dropped;
+}
+
+// Last complete received line without its terminator, or 0 if there is
+// none; stays valid until usart_rx_release_line()
+const char *usart_rx_get_line(void)
+{
+    if (!rx_ready) {
+        return 0;
+    }
+    return rx_line[rx_fill ^ 1];
+}
+
+// Gives the line buffer back to USART_RX_vect
+void usart_rx_release_line(void)
+{
+    rx_ready = 0;
+}
+
+// Received lines dropped (too long, damaged, or main loop busy) since usart_init()
+uint16_t usart_rx_get_dropped(void)
+{
+    uint8_t sreg = SREG;
+    cli();
+    uint16_t dropped = rx_dropped;
+    SREG = sreg;
+    return dropped;
 }
 
 // Transmit null-terminated string
@@ -35,54 +214,40 @@ void usart_transmit_string(const char* str)
     }
 }
 
-// Transmit number as string
-void usart_transmit_number(uint16_t number)
+// Transmit null-terminated string stored in flash (PSTR() / PROGMEM)
+void usart_transmit_string_P(const char *str)
 {
-    char buffer[6]; // Max 5 digits + null terminator
-    uint8_t i = 0;
-    
-    if (number == 0) {
-        usart_transmit('0');
-        return;
-    }
-    
-    // Convert number to string (reverse order)
-    while (number > 0) {
-        buffer[i++] = '0' + (number % 10);
-        number /= 10;
-    }
-    
-    // Transmit in correct order
-    for (uint8_t j = i; j > 0; j--) {
-        usart_transmit(buffer[j-1]);
+    char c;
+    while ((c = (char)pgm_read_byte(str)) != '\0') {
+        usart_transmit(c);
+        str++;
     }
 }
 
-// Transmit float with specified decimal places
-void usart_transmit_float(float value, uint8_t decimals)
+// Transmit number as string
+void usart_transmit_number(uint32_t number)
 {
-    // Handle negative numbers
-    if (value < 0) {
-        usart_transmit('-');
-        value = -value;
-    }
-    
-    // Extract integer part
-    uint32_t integer_part = (uint32_t)value;
-    usart_transmit_number(integer_part);
-    
-    if (decimals > 0) {
-        usart_transmit('.');
-        
-        // Extract decimal part
-        float decimal_part = value - integer_part;
-        for (uint8_t i = 0; i < decimals; i++) {
-            decimal_part *= 10;
-            uint8_t digit = (uint8_t)decimal_part;
-            usart_transmit('0' + digit);
-            decimal_part -= digit;
-        }
-    }
+    usart_transmit_fixed(number, 0);
+}
+
+// Transmit signed number as string
+void usart_transmit_signed(int32_t number)
+{
+    char buffer[NUMFMT_BUFFER_SIZE];
+    uint32_t magnitude = number < 0 ? -(uint32_t)number : (uint32_t)number;
+
+    numfmt_fixed(buffer, magnitude, 0, number < 0);
+    usart_transmit_string(buffer);
+}
+
+// Transmit fixed-point number with 'decimals' digits after the decimal point
+// (e.g. value 1234 with 1 decimal is sent as "123.4")
+void usart_transmit_fixed(uint32_t value, uint8_t decimals)
+{
+    char buffer[NUMFMT_BUFFER_SIZE];
+
+    numfmt_fixed(buffer, value, decimals, 0);
+    usart_transmit_string(buffer);
 }
 
 // Send power monitoring data via UART
@@ -90,24 +255,124 @@ void usart_send_power_data(void)
 {
     // Check if display data is ready
     if (is_display_data_ready()) {
+        // Result stamp: sequence number and Timer1 ticks of its INT0 edge
+        usart_transmit_string_P(PSTR("Sequence = "));
+        usart_transmit_number(powercalc_get_sequence());
+        usart_transmit_string_P(PSTR(" Ticks = "));
+        usart_transmit_number(powercalc_get_timestamp());
+        usart_transmit_string_P(PSTR("\r\n"));
+
         // Send actual power data
-        usart_transmit_string("Average Power = ");
-        usart_transmit_float(get_display_power(), 1);
-        usart_transmit_string(" W\r\n");
+        usart_transmit_string_P(PSTR("Average Power = "));
+        usart_transmit_fixed(get_display_power(), 1);
+        usart_transmit_string_P(PSTR(" W\r\n"));
+        
+        usart_transmit_string_P(PSTR("RMS Voltage = "));
+        usart_transmit_fixed(get_display_voltage(), 1);
+        usart_transmit_string_P(PSTR(" V\r\n"));
         
-        usart_transmit_string("RMS Voltage = ");
-        usart_transmit_float(get_display_voltage(), 1);
-        usart_transmit_string(" V\r\n");
+        usart_transmit_string_P(PSTR("Peak Current = "));
+        usart_transmit_fixed(get_peak_current_dmA(), 1);
+        usart_transmit_string_P(PSTR(" mA\r\n"));
         
-        usart_transmit_string("Peak Current = ");
-        usart_transmit_float(get_display_current(), 1);
-        usart_transmit_string(" mA\r\n");
+        usart_transmit_string_P(PSTR("RMS Current = "));
+        usart_transmit_fixed(get_rms_current_dmA(), 1);
+        usart_transmit_string_P(PSTR(" mA\r\n"));
         
-        usart_transmit_string("---\r\n");
+        // Offset reference: filtered mean with one decimal, variance in 1/1000 counts^2
+        uint16_t offset_q = adc_get_offset_filtered();
+        uint32_t variance_q = adc_get_offset_variance();
+        uint32_t variance_milli = UINT16_MAX;
+        if ((variance_q >> (2 * ADC_OFFSET_FRAC_BITS)) < (UINT16_MAX / 1000)) {
+            variance_milli = (variance_q * 1000UL) >> (2 * ADC_OFFSET_FRAC_BITS);
+        }
+        usart_transmit_string_P(PSTR("Offset = "));
+        usart_transmit_number(offset_q >> ADC_OFFSET_FRAC_BITS);
+        usart_transmit('.');
+        usart_transmit('0' + (((offset_q & ((1 << ADC_OFFSET_FRAC_BITS) - 1)) * 10) >> ADC_OFFSET_FRAC_BITS));
+        usart_transmit_string_P(PSTR(" Var(x1000) = "));
+        usart_transmit_number((uint16_t)variance_milli);
+        usart_transmit_string_P(PSTR("\r\n"));
+        
+        // Line frequency from the measured period, in 0.1 Hz
+        uint16_t line_freq_dHz = (uint16_t)((F_CPU * 10UL) / int0_get_line_period());
+        usart_transmit_string_P(PSTR("Line Frequency = "));
+        usart_transmit_fixed(line_freq_dHz, 1);
+        usart_transmit_string_P(PSTR(" Hz\r\n"));
+        
+        // Cumulative energy in Wh with 3 decimals
+        uint32_t energy_mWh = energy_get_mWh();
+        usart_transmit_string_P(PSTR("Energy = "));
+        usart_transmit_fixed(energy_mWh, 3);
+        usart_transmit_string_P(PSTR(" Wh\r\n"));
+        
+        usart_transmit_string_P(PSTR("Cycles = "));
+        usart_transmit_number(adc_get_completed_cycles());
+        usart_transmit_string_P(PSTR(" Dropped = "));
+        usart_transmit_number(adc_get_dropped_cycles());
+        usart_transmit_string_P(PSTR(" Busy = "));
+        usart_transmit_number(int0_get_busy_triggers());
+        usart_transmit_string_P(PSTR(" Stale = "));
+        usart_transmit_number(powercalc_get_stale_reports());
+        usart_transmit_string_P(PSTR("\r\n"));
+
+        usart_transmit_string_P(PSTR("TX HWM = "));
+        usart_transmit_number(usart_tx_get_high_water());
+        usart_transmit_string_P(PSTR(" Lost = "));
+        usart_transmit_number(usart_tx_get_dropped());
+        usart_transmit_string_P(PSTR("\r\n"));
+        
+        usart_transmit_string_P(PSTR("---\r\n"));
     } else {
         // Send "no signal" status message
-        usart_transmit_string("No Signal Detected\r\n");
-        usart_transmit_string("Waiting for INT0 trigger...\r\n");
-        usart_transmit_string("---\r\n");
+        usart_transmit_string_P(PSTR("No Signal Detected\r\n"));
+        usart_transmit_string_P(PSTR("Waiting for INT0 trigger...\r\n"));
+        usart_transmit_string_P(PSTR("Last Sequence = "));
+        usart_transmit_number(powercalc_get_sequence());
+        usart_transmit_string_P(PSTR(" Stale = "));
+        usart_transmit_number(powercalc_get_stale_reports());
+        usart_transmit_string_P(PSTR("\r\n"));
+        usart_transmit_string_P(PSTR("---\r\n"));
+    }
+}
+
+// USART Data Register Empty Interrupt Service Routine - sends the next queued byte
+ISR(USART_UDRE_vect)
+{
+    if (tx_head == tx_tail) {
+        UCSR0B &= ~(1 << UDRIE0);  // Queue empty: stop until the next enqueue
+        return;
+    }
+    UDR0 = tx_buffer[tx_tail];
+    tx_tail = (tx_tail + 1) & UART_TX_BUFFER_MASK;
+}
+
+// USART Receive Complete Interrupt Service Routine - collects command lines
+ISR(USART_RX_vect)
+{
+    uint8_t status = UCSR0A;
+    uint8_t data = UDR0;
+
+    if (status & ((1 << FE0) | (1 << DOR0))) {
+        rx_discard = 1;  // Damaged character: drop the whole line
+        return;
+    }
+    if (data == '\r' || data == '\n') {
+        if (rx_discard || (rx_length != 0 && rx_ready)) {
+            rx_dropped++;
+        } else if (rx_length != 0) {
+            rx_line[rx_fill][rx_length] = '\0';
+            rx_fill ^= 1;
+            rx_ready = 1;
+            sched_trigger(SCHED_TASK_COMMAND);
+        }
+        rx_length = 0;
+        rx_discard = 0;
+        return;
+    }
+    if (rx_length >= UART_RX_LINE_MAX - 1) {
+        rx_discard = 1;
+        return;
     }
+    rx_line[rx_fill][rx_length++] = (char)data;
 }
@@ -3,13 +3,57 @@
 
 #include <avr/io.h>
 #include <stdint.h>
+#include <avr/pgmspace.h>
+#include "config.h"
+
+#define UART_TX_BUFFER_MASK (UART_TX_BUFFER_SIZE - 1)
+
+/*
+ * Baud rate generator settings from F_CPU and UART_BAUD_RATE
+ *
+ * Divisor = UBRR0 + 1, rounded to nearest, for normal (16 clocks per bit)
+ * and double-speed (8 clocks per bit) mode. Normal mode samples each bit
+ * more often, so it is used whenever its error is acceptable; U2X0 is only
+ * set when it is needed (e.g. 250 kbaud at 2 MHz, divisor 1 with U2X0).
+ */
+#define UART_DIVISOR_NORMAL ((F_CPU + 8ULL * UART_BAUD_RATE) / (16ULL * UART_BAUD_RATE))
+#define UART_DIVISOR_DOUBLE ((F_CPU + 4ULL * UART_BAUD_RATE) / (8ULL * UART_BAUD_RATE))
+
+// Error of the rate a divisor produces, in 0.1 % (1000 if the divisor is 0)
+#define UART_BAUD_RATE_X1000(clocks, divisor) \
+    (F_CPU * 1000ULL / ((clocks) * (divisor) * 1ULL * UART_BAUD_RATE))
+#define UART_BAUD_ERROR(clocks, divisor) \
+    ((divisor) == 0 ? 1000ULL \
+     : UART_BAUD_RATE_X1000(clocks, divisor) >= 1000ULL \
+         ? UART_BAUD_RATE_X1000(clocks, divisor) - 1000ULL \
+         : 1000ULL - UART_BAUD_RATE_X1000(clocks, divisor))
+
+#if UART_BAUD_ERROR(16, UART_DIVISOR_NORMAL) <= UART_BAUD_MAX_ERROR
+#define UART_USE_2X 0
+#define UART_UBRR_VALUE (UART_DIVISOR_NORMAL - 1)
+#define UART_BAUD_ERROR_ACTUAL UART_BAUD_ERROR(16, UART_DIVISOR_NORMAL)
+#else
+#define UART_USE_2X 1
+#define UART_UBRR_VALUE (UART_DIVISOR_DOUBLE - 1)
+#define UART_BAUD_ERROR_ACTUAL UART_BAUD_ERROR(8, UART_DIVISOR_DOUBLE)
+#endif
 
 // Function declarations
-void usart_init(uint8_t prescaler);
+void usart_init(void);
 void usart_transmit(uint8_t data);
+uint8_t usart_tx_enqueue(uint8_t data);
+uint8_t usart_tx_free(void);
+void usart_tx_flush(void);
+uint8_t usart_tx_get_high_water(void);
+uint16_t usart_tx_get_dropped(void);
+const char *usart_rx_get_line(void);
+void usart_rx_release_line(void);
+uint16_t usart_rx_get_dropped(void);
 void usart_transmit_string(const char* str);
-void usart_transmit_number(uint16_t number);
-void usart_transmit_float(float value, uint8_t decimals);
+void usart_transmit_string_P(const char *str);
+void usart_transmit_number(uint32_t number);
+void usart_transmit_signed(int32_t number);
+void usart_transmit_fixed(uint32_t value, uint8_t decimals);
 void usart_send_power_data(void);
 
 #endif // UART_H